@@ -0,0 +1,98 @@
+/*
+    Microbenchmark for the dotted-quad conversion kernels in ipconv.cpp
+    against the stringstream / to_string versions they replaced.
+
+    Build and run with: make bench-ipconv
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ipconv.h"
+
+// The original ipToNum() and numToIP() from router.cpp
+static uint32_t legacyIpToNum(const std::string &ipStr) {
+    uint32_t b1, b2, b3, b4;
+    char dot;
+    std::stringstream ss(ipStr);
+    ss >> b1 >> dot >> b2 >> dot >> b3 >> dot >> b4;
+    return (b1 << 24) | (b2 << 16) | (b3 << 8) | b4;
+}
+
+static std::string legacyNumToIP(uint32_t ip) {
+    return std::to_string((ip >> 24) & 0xFF) + "." + std::to_string((ip >> 16) & 0xFF) + "." + std::to_string((ip >>  8) & 0xFF) + "." + std::to_string(ip & 0xFF);
+}
+
+// Runs fn over every address and reports nanoseconds per call
+template <typename Fn>
+static double timeIt(const char *label, size_t count, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sink = fn();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    printf("  %-28s %8.2f ns/op  (checksum %llu)\n", label, ns, (unsigned long long) sink);
+    return ns;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 2000000;
+
+    std::mt19937 rng(471);
+    std::vector<uint32_t> addrs(count);
+    for (auto &a : addrs) {
+        a = rng();
+    }
+
+    // One newline separated buffer, the same shape as an --mmap input file
+    std::string text;
+    std::vector<std::string> lines;
+    lines.reserve(count);
+    for (uint32_t a : addrs) {
+        lines.push_back(legacyNumToIP(a));
+        text += lines.back();
+        text += '\n';
+    }
+
+    printf("dotted-quad parse (%zu addresses, simd: %s)\n", count, ipv4ParserName());
+    double oldParse = timeIt("stringstream ipToNum", count, [&] {
+        uint64_t sum = 0;
+        for (auto &l : lines) {
+            sum += legacyIpToNum(l);
+        }
+        return sum;
+    });
+    double newParse = timeIt("parseIPv4Fast", count, [&] {
+        uint64_t sum = 0;
+        const char *p = text.data(), *end = p + text.size();
+        while (p < end) {
+            uint32_t ip = 0;
+            parseIPv4Fast(p, end, ip);
+            sum += ip;
+            p++;
+        }
+        return sum;
+    });
+
+    printf("dotted-quad format\n");
+    double oldFormat = timeIt("to_string numToIP", count, [&] {
+        uint64_t sum = 0;
+        for (uint32_t a : addrs) {
+            sum += legacyNumToIP(a).size();
+        }
+        return sum;
+    });
+    double newFormat = timeIt("formatIPv4", count, [&] {
+        uint64_t sum = 0;
+        char buf[IPV4_BUF];
+        for (uint32_t a : addrs) {
+            sum += formatIPv4(a, buf) + (unsigned char) buf[0];
+        }
+        return sum;
+    });
+
+    printf("speedup: parse %.1fx, format %.1fx\n", oldParse / newParse, oldFormat / newFormat);
+    return 0;
+}
@@ -0,0 +1,309 @@
+/*
+    Benchmark for the longest prefix match engines. Builds synthetic route
+    tables with the prefix length mix of the public IPv4 table, or loads a
+    real one, and times every engine on the same destinations.
+
+    Build and run with: make bench
+    Options: lpm_bench [-n <prefixes,...>] [-l <lookups>] [-z <zipf exponent>]
+                       [-r <routeTable>] [-i <inputFile>] [-H <0|1>] [-w <dir>]
+    -H 1 puts the tables on huge pages as router --hugepages does.
+    -w writes the last table and its destinations to dir as interfaces.txt,
+    routes.txt and input.txt for the router instead, e.g. to train PGO builds.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "router.h"
+#include "hugepages.h"
+#include "lpm.h"
+#include "simd.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Share of each prefix length in percent, roughly today's BGP table
+static const double LENGTH_MIX[33] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0.02, 0.01, 0.03, 0.1, 0.3, 0.6, 1.1, 1.9, 1.5,
+    1.2, 2.0, 3.3, 4.4, 4.6, 10.0, 9.3, 59.4, 0.1, 0.1, 0.05, 0.05, 0.05, 0.05, 0, 0.1,
+};
+
+// The slow scans only get this many prefix comparisons in total
+static const double SCAN_BUDGET = 2e8;
+
+struct Result {
+    double buildMs = 0;
+    size_t memory = 0;
+    double mlps = 0;
+    double p50 = 0;
+    double p99 = 0;
+    size_t lookups = 0;
+    bool ok = true;
+};
+
+static PrefixTable syntheticTable(size_t n, std::mt19937 &rng) {
+    std::discrete_distribution<int> length(std::begin(LENGTH_MIX), std::end(LENGTH_MIX));
+    std::unordered_set<uint64_t> seen;
+    PrefixTable table;
+    table.reserve(n);
+    while (table.size() < n) {
+        int len = length(rng);
+        uint32_t net = applyMask(rng(), len);
+        if (seen.insert((uint64_t) net << 8 | len).second) {
+            // A few hundred distinct next hops, like a well connected edge router
+            table.add(net, len, (int) (rng() % 256));
+        }
+    }
+    return table;
+}
+
+static bool loadTable(const std::string &path, PrefixTable &table) {
+    NextHopTable hops;
+    std::unordered_set<uint64_t> seen;
+    std::vector<RouteEntry> routes;
+    if (!parseRoutes(path, routes)) {
+        return false;
+    }
+    for (auto &r : routes) {
+        if (seen.insert((uint64_t) r.network << 8 | r.maskLen).second) {
+            table.add(r.network, r.maskLen, hops.addGateway(r.nextHop));
+        }
+    }
+    return true;
+}
+
+// Mostly addresses inside some prefix, so the lookups have work to do. With
+// a zipf exponent the stream repeats a pool of them with skewed popularity.
+static std::vector<uint32_t> syntheticDests(const PrefixTable &table, size_t n, double zipf, std::mt19937 &rng) {
+    auto one = [&] {
+        if (table.size() == 0 || rng() % 10 == 0) {
+            return (uint32_t) rng();
+        }
+        size_t i = rng() % table.size();
+        return (uint32_t) (table.network[i] | (rng() & ~table.mask[i]));
+    };
+
+    std::vector<uint32_t> dests(n);
+    if (zipf <= 0) {
+        for (auto &d : dests) {
+            d = one();
+        }
+        return dests;
+    }
+
+    std::vector<uint32_t> pool(65536);
+    std::vector<double> cumulative(pool.size());
+    double sum = 0;
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i] = one();
+        sum += 1.0 / std::pow((double) (i + 1), zipf);
+        cumulative[i] = sum;
+    }
+    std::uniform_real_distribution<double> pick(0, sum);
+    for (auto &d : dests) {
+        d = pool[std::lower_bound(cumulative.begin(), cumulative.end(), pick(rng)) - cumulative.begin()];
+    }
+    return dests;
+}
+
+static std::vector<uint32_t> loadDests(const std::string &path) {
+    std::vector<uint32_t> dests;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#') {
+            dests.push_back(ipToNum(line));
+        }
+    }
+    return dests;
+}
+
+// Router config and input for table and dests. Next hop i becomes a gateway
+// on one of 16 interface subnets, 10.(i % 16).0.0/16.
+static bool writeRouterFiles(const std::string &dir, const PrefixTable &table, const std::vector<uint32_t> &dests) {
+    std::ofstream interfaces(dir + "/interfaces.txt"), routes(dir + "/routes.txt"), input(dir + "/input.txt");
+    for (int i = 0; i < 16; i++) {
+        interfaces << "eth" << i << " 10." << i << ".255.254/16\n";
+    }
+    for (size_t i = 0; i < table.size(); i++) {
+        int hop = table.hop[i];
+        routes << numToIP(table.network[i]) << "/" << (int) table.maskLen[i] << " 10." << hop % 16 << "." << hop / 16 << ".1\n";
+    }
+    for (uint32_t d : dests) {
+        input << numToIP(d) << "\n";
+    }
+    return (bool) interfaces.flush() && (bool) routes.flush() && (bool) input.flush();
+}
+
+static double percentile(std::vector<double> &v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    size_t k = std::min(v.size() - 1, (size_t) (p * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+// Throughput from the batched call, latency from single lookups timed in
+// groups of 8 so each sample is well above the clock's resolution
+template <typename Batch, typename Single>
+static void measure(Result &res, const std::vector<uint32_t> &dests, size_t count, Batch batch, Single single,
+                    const std::vector<int> &expect) {
+    std::vector<int> hops(count);
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; i += LpmEngine::BATCH) {
+        batch(&dests[i], &hops[i], std::min(LpmEngine::BATCH, count - i));
+    }
+    res.mlps = count / std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    res.lookups = count;
+    for (size_t i = 0; i < count && i < expect.size(); i++) {
+        res.ok = res.ok && hops[i] == expect[i];
+    }
+
+    const size_t GROUP = 8;
+    std::vector<double> samples;
+    samples.reserve(count / GROUP);
+    volatile int sink = 0;
+    for (size_t i = 0; i + GROUP <= count; i += GROUP) {
+        auto t = Clock::now();
+        int acc = 0;
+        for (size_t j = i; j < i + GROUP; j++) {
+            acc += single(dests[j]);
+        }
+        samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - t).count() / GROUP);
+        sink = sink + acc;
+    }
+    res.p50 = percentile(samples, 0.50);
+    res.p99 = percentile(samples, 0.99);
+}
+
+static void printRow(size_t prefixes, const char *engine, const Result &r) {
+    printf("%9zu  %-9s %9.1f %11zu %11.2f %8.1f %8.1f %9zu  %s\n", prefixes, engine, r.buildMs, r.memory / 1024, r.mlps,
+           r.p50, r.p99, r.lookups, r.ok ? "ok" : "MISMATCH");
+}
+
+static void benchTable(const PrefixTable &table, const std::vector<uint32_t> &dests) {
+    // Every engine is checked against the trie's answers
+    std::vector<int> expect(dests.size());
+    auto reference = makeEngine("trie");
+    reference->build(table);
+    for (size_t i = 0; i < dests.size(); i++) {
+        expect[i] = reference->lookup(dests[i]);
+    }
+
+    size_t scanCount = std::min(dests.size(), std::max((size_t) 1000, (size_t) (SCAN_BUDGET / std::max((size_t) 1, table.size()))));
+
+    // The original findRoute() over the parsed RouteEntry list
+    {
+        Result res;
+        auto start = Clock::now();
+        std::vector<RouteEntry> routes(table.size());
+        for (size_t i = 0; i < table.size(); i++) {
+            routes[i] = {table.network[i], table.maskLen[i], (uint32_t) table.hop[i]};
+        }
+        res.buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        res.memory = routes.size() * sizeof(RouteEntry);
+        auto single = [&](uint32_t d) {
+            RouteEntry *r = findRoute(d, routes);
+            return r ? (int) r->nextHop : NO_ROUTE;
+        };
+        measure(res, dests, scanCount, [&](const uint32_t *d, int *h, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                h[i] = single(d[i]);
+            }
+        }, single, expect);
+        printRow(table.size(), "findRoute", res);
+    }
+
+    for (const char *name : {"linear", "simd", "trie", "dir24", "poptrie"}) {
+        auto engine = makeEngine(name);
+        Result res;
+        auto start = Clock::now();
+        if (!engine->build(table)) {
+            printf("%9zu  %-9s  cannot hold this table\n", table.size(), name);
+            continue;
+        }
+        res.buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        res.memory = engine->memoryUsage();
+        bool scan = std::string(name) == "linear" || std::string(name) == "simd";
+        measure(res, dests, scan ? scanCount : dests.size(),
+                [&](const uint32_t *d, int *h, size_t n) { engine->lookupBatch(d, h, n); },
+                [&](uint32_t d) { return engine->lookup(d); }, expect);
+        printRow(table.size(), name, res);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+    size_t lookups = 1000000;
+    double zipf = 0;
+    std::string routeFile, inputFile, writeDir;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i], arg = argv[i + 1];
+        if (flag == "-n") {
+            sizes.clear();
+            for (size_t pos = 0; pos < arg.size();) {
+                size_t comma = arg.find(',', pos);
+                sizes.push_back(std::stoul(arg.substr(pos, comma - pos)));
+                pos = comma == std::string::npos ? arg.size() : comma + 1;
+            }
+        } else if (flag == "-l") {
+            lookups = std::stoul(arg);
+        } else if (flag == "-z") {
+            zipf = std::stod(arg);
+        } else if (flag == "-r") {
+            routeFile = arg;
+        } else if (flag == "-i") {
+            inputFile = arg;
+        } else if (flag == "-w") {
+            writeDir = arg;
+        } else if (flag == "-H") {
+            setHugePages(arg == "1");
+        } else {
+            printf("Usage: lpm_bench [-n <prefixes,...>] [-l <lookups>] [-z <zipf exponent>] [-r <routeTable>] [-i <inputFile>] [-H <0|1>] [-w <dir>]\n");
+            return 1;
+        }
+    }
+
+    // An engine that cannot hold a table says so in its row instead
+    LOG_LEVEL = 1;
+    std::mt19937 rng(471);
+    if (!writeDir.empty()) {
+        PrefixTable table = syntheticTable(sizes.back(), rng);
+        if (!writeRouterFiles(writeDir, table, syntheticDests(table, lookups, zipf, rng))) {
+            printf("Could not write the router files to %s\n", writeDir.c_str());
+            return 1;
+        }
+        printf("Wrote %zu prefixes and %zu destinations to %s\n", table.size(), lookups, writeDir.c_str());
+        return 0;
+    }
+    SimdLinearEngine simd;
+    printf("lpm bench: %s destinations, simd isa %s, %s pages\n", !inputFile.empty() ? inputFile.c_str() : zipf > 0 ? "zipf" : "uniform",
+           simd.isa(), hugePagesEnabled() ? "huge" : "normal");
+    printf("%9s  %-9s %9s %11s %11s %8s %8s %9s  %s\n", "prefixes", "engine", "build ms", "memory KB", "Mlookups/s", "p50 ns",
+           "p99 ns", "lookups", "check");
+
+    std::vector<PrefixTable> tables;
+    if (!routeFile.empty()) {
+        tables.emplace_back();
+        if (!loadTable(routeFile, tables.back())) {
+            return 1;
+        }
+    } else {
+        for (size_t n : sizes) {
+            tables.push_back(syntheticTable(n, rng));
+        }
+    }
+    for (auto &table : tables) {
+        std::vector<uint32_t> dests = inputFile.empty() ? syntheticDests(table, lookups, zipf, rng) : loadDests(inputFile);
+        benchTable(table, dests);
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <numeric>
+
+#include "dir24.h"
+
+bool Dir24Table::build(const PrefixTable &prefixes) {
+    int maxHop = prefixes.size() ? *std::max_element(prefixes.hop.begin(), prefixes.hop.end()) : 0;
+    if (maxHop >= MAX_HOPS) {
+        ERROR << "Too many next hops for the dir24 table (" << maxHop + 1 << ")." << ENDL;
+        return false;
+    }
+
+    // Shorter prefixes are written first so longer ones overwrite them. Equal
+    // prefixes go in reverse file order so the first one ends up in the table.
+    std::vector<size_t> order(prefixes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (prefixes.maskLen[a] != prefixes.maskLen[b]) {
+            return prefixes.maskLen[a] < prefixes.maskLen[b];
+        }
+        return a > b;
+    });
+
+    own24.assign(1 << 24, 0);
+    own8.clear();
+    depth24.assign(updatable ? 1 << 24 : 0, 0);
+    depth8.clear();
+    routes.clear();
+
+    for (size_t i : order) {
+        int maskLen = prefixes.maskLen[i];
+        uint16_t value = (uint16_t) (prefixes.hop[i] + 1);
+        uint32_t network = prefixes.network[i];
+
+        if (updatable) {
+            routes[(uint64_t) network << 8 | maskLen] = prefixes.hop[i];
+        }
+
+        if (maskLen <= 24) {
+            uint32_t first = network >> 8;
+            uint32_t count = 1u << (24 - maskLen);
+            std::fill(own24.begin() + first, own24.begin() + first + count, value);
+            if (updatable) {
+                std::fill(depth24.begin() + first, depth24.begin() + first + count, (uint8_t) maskLen);
+            }
+            continue;
+        }
+
+        // Longer than /24, push the covering entry down into an extension block
+        uint16_t &entry = own24[network >> 8];
+        if (!(entry & EXTENDED)) {
+            size_t block = own8.size() >> 8;
+            if (block >= (size_t) MAX_BLOCKS) {
+                ERROR << "Too many prefixes longer than /24 for the dir24 table." << ENDL;
+                return false;
+            }
+            own8.resize(own8.size() + 256, entry);
+            if (updatable) {
+                depth8.resize(own8.size(), depth24[network >> 8]);
+            }
+            entry = (uint16_t) (EXTENDED | block);
+        }
+        size_t first = ((size_t) (entry & ~EXTENDED) << 8) | (network & 0xFF);
+        size_t count = (size_t) 1 << (32 - maskLen);
+        std::fill(own8.begin() + first, own8.begin() + first + count, value);
+        if (updatable) {
+            std::fill(depth8.begin() + first, depth8.begin() + first + count, (uint8_t) maskLen);
+        }
+    }
+
+    tbl24 = own24.data();
+    tbl8 = own8.data();
+    tbl8Size = own8.size();
+    return true;
+}
+
+bool Dir24Table::update(uint32_t prefix, int maskLen, int hop) {
+    if (!updatable) {
+        updatable = true;
+        return false;
+    }
+    prefix = applyMask(prefix, maskLen);
+    uint64_t key = (uint64_t) prefix << 8 | maskLen;
+
+    if (hop != NO_ROUTE) {
+        if (hop >= MAX_HOPS) {
+            return false;
+        }
+        routes[key] = hop;
+        return paint(prefix, maskLen, (uint16_t) (hop + 1), (uint8_t) maskLen, false);
+    }
+
+    // Hand the entries back to the longest shorter prefix, if there is one
+    if (!routes.erase(key)) {
+        return true;
+    }
+    for (int len = maskLen - 1; len >= 0; len--) {
+        auto it = routes.find((uint64_t) applyMask(prefix, len) << 8 | len);
+        if (it != routes.end()) {
+            return paint(prefix, maskLen, (uint16_t) (it->second + 1), (uint8_t) len, true);
+        }
+    }
+    return paint(prefix, maskLen, 0, 0, true);
+}
+
+bool Dir24Table::paint(uint32_t prefix, int maskLen, uint16_t value, uint8_t newDepth, bool withdraw) {
+    auto set = [&](uint16_t &entry, uint8_t &depth) {
+        if (withdraw ? depth == maskLen : depth <= maskLen) {
+            entry = value;
+            depth = newDepth;
+        }
+    };
+    auto setBlock = [&](size_t block, size_t first, size_t count) {
+        for (size_t j = (block << 8) + first; j < (block << 8) + first + count; j++) {
+            set(own8[j], depth8[j]);
+        }
+    };
+
+    if (maskLen <= 24) {
+        uint32_t first = prefix >> 8;
+        uint32_t count = 1u << (24 - maskLen);
+        for (uint32_t i = first; i < first + count; i++) {
+            if (own24[i] & EXTENDED) {
+                setBlock(own24[i] & ~EXTENDED, 0, 256);
+            } else {
+                set(own24[i], depth24[i]);
+            }
+        }
+        return true;
+    }
+
+    // Extension blocks stay once created, a rebuild compacts them again
+    uint16_t &entry = own24[prefix >> 8];
+    if (!(entry & EXTENDED)) {
+        if (withdraw) {
+            return true;
+        }
+        size_t block = own8.size() >> 8;
+        if (block >= (size_t) MAX_BLOCKS) {
+            return false;
+        }
+        own8.resize(own8.size() + 256, entry);
+        depth8.resize(own8.size(), depth24[prefix >> 8]);
+        entry = (uint16_t) (EXTENDED | block);
+        tbl8 = own8.data();
+        tbl8Size = own8.size();
+    }
+    setBlock(entry & ~EXTENDED, prefix & 0xFF, (size_t) 1 << (32 - maskLen));
+    return true;
+}
+
+int Dir24Table::lookup(uint32_t dest) const {
+    uint16_t entry = tbl24[dest >> 8];
+    if (entry & EXTENDED) {
+        entry = tbl8[((size_t) (entry & ~EXTENDED) << 8) | (dest & 0xFF)];
+    }
+    return (int) entry - 1;
+}
+
+void Dir24Table::lookupBatch(const uint32_t *dests, int *hops, size_t n) const {
+    // Start every first level read before using any of them
+    for (size_t i = 0; i < n; i++) {
+        __builtin_prefetch(&tbl24[dests[i] >> 8]);
+    }
+
+    // Then the extension blocks, for the entries that need one
+    uint16_t entries[BATCH];
+    for (size_t i = 0; i < n; i++) {
+        entries[i] = tbl24[dests[i] >> 8];
+        if (entries[i] & EXTENDED) {
+            __builtin_prefetch(&tbl8[((size_t) (entries[i] & ~EXTENDED) << 8) | (dests[i] & 0xFF)]);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        uint16_t entry = entries[i];
+        if (entry & EXTENDED) {
+            entry = tbl8[((size_t) (entry & ~EXTENDED) << 8) | (dests[i] & 0xFF)];
+        }
+        hops[i] = (int) entry - 1;
+    }
+}
+
+size_t Dir24Table::memoryUsage() const {
+    return ((size_t) (1 << 24) + tbl8Size) * sizeof(uint16_t) + depth24.size() + depth8.size();
+}
+
+std::vector<std::pair<const void *, size_t>> Dir24Table::exportArrays() const {
+    return {{tbl24, ((size_t) 1 << 24) * sizeof(uint16_t)}, {tbl8, tbl8Size * sizeof(uint16_t)}};
+}
+
+bool Dir24Table::attachArrays(const std::vector<std::pair<const void *, size_t>> &arrays, size_t values) {
+    if (arrays.size() != 2 || arrays[0].second != ((size_t) 1 << 24) * sizeof(uint16_t) || arrays[1].second % (256 * sizeof(uint16_t))) {
+        return false;
+    }
+    const uint16_t *first = static_cast<const uint16_t *>(arrays[0].first);
+    const uint16_t *second = static_cast<const uint16_t *>(arrays[1].first);
+    size_t secondSize = arrays[1].second / sizeof(uint16_t);
+
+    // Lookups follow block numbers and return values without checks, so
+    // every block must exist and every value be a next hop + 1, or 0
+    size_t blocks = secondSize >> 8;
+    for (size_t i = 0; i < ((size_t) 1 << 24); i++) {
+        uint16_t entry = first[i];
+        if ((entry & EXTENDED) ? (size_t) (entry & ~EXTENDED) >= blocks : entry > values) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < secondSize; i++) {
+        if (second[i] > values) {
+            return false;
+        }
+    }
+
+    own24.clear();
+    own8.clear();
+    updatable = false;
+    tbl24 = first;
+    tbl8 = second;
+    tbl8Size = secondSize;
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef DIR24_H
+#define DIR24_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "hugepages.h"
+#include "lpm.h"
+
+// DIR-24-8 direct lookup table. The first level has one 16 bit entry for
+// every /24, so most lookups are a single memory read. Entries for /24s that
+// contain longer prefixes point at a 256 entry extension block indexed by the
+// last octet instead.
+//
+// Entry encoding (both levels): 0 means no route, otherwise next hop + 1.
+// A first level entry with EXTENDED set holds an extension block number.
+class Dir24Table : public LpmEngine {
+public:
+    const char *name() const override { return "dir24"; }
+    bool build(const PrefixTable &prefixes) override;
+    int lookup(uint32_t dest) const override;
+    void lookupBatch(const uint32_t *dests, int *hops, size_t n) const override;
+    size_t memoryUsage() const override;
+    size_t valueLimit() const override { return MAX_HOPS; }
+    std::vector<std::pair<const void *, size_t>> exportArrays() const override;
+    bool attachArrays(const std::vector<std::pair<const void *, size_t>> &arrays, size_t values) override;
+
+    // Rewrites just the entries the prefix covers. The first update asks for
+    // a rebuild, which also records what in place updates need to know.
+    bool update(uint32_t prefix, int maskLen, int hop) override;
+
+    static constexpr uint16_t EXTENDED = 0x8000;
+    static constexpr int MAX_HOPS = EXTENDED - 1;
+    static constexpr int MAX_BLOCKS = EXTENDED;
+
+private:
+    // Storage for a table built here; lookups go through the pointers, which
+    // may point into a mapped snapshot instead
+    HugeVector<uint16_t> own24;
+    HugeVector<uint16_t> own8;
+    const uint16_t *tbl24 = nullptr;
+    const uint16_t *tbl8 = nullptr;
+    size_t tbl8Size = 0;
+
+    // Set entries under prefix/maskLen to value. An announcement takes the
+    // entries no longer prefix owns, a withdrawal the ones maskLen itself owned.
+    bool paint(uint32_t prefix, int maskLen, uint16_t value, uint8_t newDepth, bool withdraw);
+
+    // Only kept once update() was called: the length of the prefix behind
+    // each entry, and every prefix to find what covers a withdrawn one
+    bool updatable = false;
+    std::vector<uint8_t> depth24;
+    std::vector<uint8_t> depth8;
+    std::unordered_map<uint64_t, int> routes;
+};
+
+#endif
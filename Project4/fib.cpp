@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <unordered_set>
+
+#include "fib.h"
+
+// Smaller tables are selected and indexed on the calling thread
+static const size_t PARALLEL_MIN_ROUTES = 1 << 16;
+
+// True if a connected subnet contains the whole route prefix
+static bool shadowedByConnected(uint32_t network, int maskLen, const InterfaceTable &ifs) {
+    for (size_t i = 0; i < ifs.size(); i++) {
+        if (ifs.maskLen[i] <= maskLen && applyMask(network, ifs.maskLen[i]) == ifs.network[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Interface whose subnet holds addr, longest mask first, or UNRESOLVED
+static int outgoingInterface(uint32_t addr, const InterfaceTable &ifs) {
+    int best = UNRESOLVED;
+    int bestMask = -1;
+    for (size_t i = 0; i < ifs.size(); i++) {
+        if (applyMask(addr, ifs.maskLen[i]) == ifs.network[i] && ifs.maskLen[i] > bestMask) {
+            bestMask = ifs.maskLen[i];
+            best = (int) i;
+        }
+    }
+    return best;
+}
+
+void InterfaceTable::clear() {
+    ip.clear();
+    network.clear();
+    maskLen.clear();
+    nameStart.assign(1, 0);
+    names.clear();
+}
+
+void InterfaceTable::add(const InterfaceEntry &e) {
+    ip.push_back(e.ip);
+    network.push_back(e.network);
+    maskLen.push_back((uint8_t) e.maskLen);
+    names += e.name;
+    nameStart.push_back((uint32_t) names.size());
+}
+
+bool Fib::build(std::vector<InterfaceEntry> ifs, const std::vector<RouteEntry> &routes, std::unique_ptr<LpmEngine> lpm,
+                int threads) {
+    interfaces.clear();
+    prefixes.clear();
+    prefixes.reserve(ifs.size() + routes.size());
+    prefixIndex.clear();
+    hops.clear();
+    mapping.reset();
+
+    // Connected subnets go first so they win ties against equal static
+    // prefixes, and the first of several identical subnets is kept
+    for (size_t i = 0; i < ifs.size(); i++) {
+        interfaces.add(ifs[i]);
+        int hop = hops.addConnected((int) i);
+        if (prefixIndex.emplace(prefixKey(ifs[i].network, ifs[i].maskLen), (uint32_t) prefixes.size()).second) {
+            prefixes.add(ifs[i].network, ifs[i].maskLen, hop);
+        }
+    }
+
+    // A connected match always beats a static route, even a longer one, so a
+    // route inside a connected subnet can never be chosen and is left out
+    if (threads <= 1 || routes.size() < PARALLEL_MIN_ROUTES) {
+        prefixIndex.reserve(prefixes.size() + routes.size());
+        for (auto &r : routes) {
+            if (shadowedByConnected(r.network, r.maskLen, interfaces)) {
+                DEBUG << "Route " << numToIP(r.network) << "/" << r.maskLen << " is inside a connected subnet, skipping." << ENDL;
+                continue;
+            }
+            if (!prefixIndex.emplace(prefixKey(r.network, r.maskLen), (uint32_t) prefixes.size()).second) {
+                DEBUG << "Route " << numToIP(r.network) << "/" << r.maskLen << " is listed twice, keeping the first." << ENDL;
+                continue;
+            }
+            prefixes.add(r.network, r.maskLen, hops.addGateway(r.nextHop));
+        }
+        hops.resolve(ifs);
+        assignRouteIds();
+        return installEngine(std::move(lpm));
+    }
+
+    std::vector<uint8_t> keep = selectRoutes(routes, threads);
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (keep[i]) {
+            prefixes.add(routes[i].network, routes[i].maskLen, hops.addGateway(routes[i].nextHop));
+        }
+    }
+    hops.resolve(ifs);
+    assignRouteIds();
+
+    // Only updates need the prefix index, so it fills while the engine builds
+    std::thread indexer(&Fib::indexPrefixes, this);
+    bool built = installEngine(std::move(lpm), threads);
+    indexer.join();
+    return built;
+}
+
+std::vector<uint8_t> Fib::selectRoutes(const std::vector<RouteEntry> &routes, int threads) const {
+    std::vector<uint8_t> keep(routes.size(), 0);
+    auto select = [&](int part) {
+        std::unordered_set<uint64_t> seen;
+        seen.reserve(2 * routes.size() / threads);
+        for (size_t i = 0; i < routes.size(); i++) {
+            const RouteEntry &r = routes[i];
+            uint64_t key = prefixKey(r.network, r.maskLen);
+            if ((int) (((key * 0x9E3779B97F4A7C15ull) >> 32) % (uint64_t) threads) != part) {
+                continue;
+            }
+            if (shadowedByConnected(r.network, r.maskLen, interfaces)) {
+                DEBUG << "Route " << numToIP(r.network) << "/" << r.maskLen << " is inside a connected subnet, skipping." << ENDL;
+            } else if (!seen.insert(key).second) {
+                DEBUG << "Route " << numToIP(r.network) << "/" << r.maskLen << " is listed twice, keeping the first." << ENDL;
+            } else {
+                keep[i] = 1;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++) {
+        workers.emplace_back(select, t);
+    }
+    select(0);
+    for (auto &w : workers) {
+        w.join();
+    }
+    return keep;
+}
+
+bool Fib::buildEngine(LpmEngine &e, int threads) const {
+    if (!tracking) {
+        return e.buildParallel(prefixes, threads);
+    }
+    PrefixTable numbered = prefixes;
+    std::iota(numbered.hop.begin(), numbered.hop.end(), 0);
+    return e.buildParallel(numbered, threads);
+}
+
+bool Fib::installEngine(std::unique_ptr<LpmEngine> e, int threads) {
+    // With tracking the values are prefix positions, which dir24 runs out of
+    // long before next hops
+    if (valueCount() > e->valueLimit()) {
+        WARNING << "The " << e->name() << " engine cannot hold " << valueCount() << (tracking ? " tracked routes" : " next hops")
+                << ", using the trie instead." << ENDL;
+        e = makeEngine("trie");
+    }
+    engine = std::move(e);
+    return buildEngine(*engine, threads);
+}
+
+void Fib::assignRouteIds() {
+    routeIds.clear();
+    routeNames.clear();
+    if (!tracking) {
+        return;
+    }
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        routeIds.push_back((int32_t) i);
+        routeNames.push_back({prefixes.network[i], prefixes.maskLen[i], (bool) hops.connected[prefixes.hop[i]]});
+    }
+}
+
+std::unique_ptr<Fib> Fib::clone() const {
+    std::unique_ptr<Fib> copy(new Fib());
+    copy->interfaces = interfaces;
+    copy->prefixes = prefixes;
+    copy->hops = hops;
+    copy->prefixIndex = prefixIndex;
+    copy->changes = changes;
+    copy->tracking = tracking;
+    copy->routeIds = routeIds;
+    copy->routeNames = routeNames;
+    copy->engine = makeEngine(engine->name());
+    copy->buildEngine(*copy->engine);
+    return copy;
+}
+
+void Fib::indexPrefixes() {
+    prefixIndex.clear();
+    prefixIndex.reserve(prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        prefixIndex.emplace(prefixKey(prefixes.network[i], prefixes.maskLen[i]), (uint32_t) i);
+    }
+}
+
+bool Fib::addRoute(uint32_t network, int maskLen, uint32_t nextHop) {
+    network = applyMask(network, maskLen);
+    if (shadowedByConnected(network, maskLen, interfaces)) {
+        DEBUG << "Route " << numToIP(network) << "/" << maskLen << " is inside a connected subnet, ignoring update." << ENDL;
+        return false;
+    }
+
+    size_t known = hops.addrs.size();
+    int hop = hops.addGateway(nextHop);
+    if (hops.addrs.size() != known) {
+        hops.iface[hop] = outgoingInterface(nextHop, interfaces);
+        if (hops.iface[hop] == UNRESOLVED) {
+            WARNING << "Next hop " << numToIP(nextHop) << " is not on any interface subnet." << ENDL;
+        }
+    }
+
+    auto it = prefixIndex.find(prefixKey(network, maskLen));
+    uint32_t pos;
+    if (it != prefixIndex.end()) {
+        pos = it->second;
+        prefixes.hop[pos] = hop;
+    } else {
+        pos = (uint32_t) prefixes.size();
+        prefixIndex.emplace(prefixKey(network, maskLen), pos);
+        prefixes.add(network, maskLen, hop);
+        if (tracking) {
+            routeIds.push_back((int32_t) routeNames.size());
+            routeNames.push_back({network, (uint8_t) maskLen, false});
+        }
+    }
+    return updateEngine(network, maskLen, tracking ? (int) pos : hop);
+}
+
+bool Fib::withdrawRoute(uint32_t network, int maskLen) {
+    network = applyMask(network, maskLen);
+    auto it = prefixIndex.find(prefixKey(network, maskLen));
+    if (it == prefixIndex.end() || hops.connected[prefixes.hop[it->second]]) {
+        DEBUG << "No static route " << numToIP(network) << "/" << maskLen << " to withdraw." << ENDL;
+        return false;
+    }
+
+    // The last prefix moves into the freed slot. Next hops are kept, they
+    // are few and likely to be announced again.
+    uint32_t pos = it->second;
+    prefixIndex.erase(it);
+    prefixes.removeAt(pos);
+    if (tracking) {
+        routeIds[pos] = routeIds.back();
+        routeIds.pop_back();
+    }
+    if (pos == prefixes.size()) {
+        return updateEngine(network, maskLen, NO_ROUTE);
+    }
+    prefixIndex[prefixKey(prefixes.network[pos], prefixes.maskLen[pos])] = pos;
+    return updateEngine(network, maskLen, NO_ROUTE, tracking ? pos : SIZE_MAX);
+}
+
+bool Fib::updateEngine(uint32_t network, int maskLen, int value, size_t moved) {
+    changes++;
+    if (valueCount() > engine->valueLimit()) {
+        return installEngine(std::move(engine));
+    }
+    bool inPlace = engine->update(network, maskLen, value);
+    if (inPlace && moved != SIZE_MAX) {
+        inPlace = engine->update(prefixes.network[moved], prefixes.maskLen[moved], (int) moved);
+    }
+    if (inPlace || buildEngine(*engine)) {
+        return true;
+    }
+
+    // The table outgrew the engine, the trie takes any number of prefixes
+    WARNING << "The " << engine->name() << " engine cannot hold " << prefixes.size() << " prefixes, switching to the trie." << ENDL;
+    engine = makeEngine("trie");
+    return buildEngine(*engine);
+}
+
+// Turns an engine answer into the forwarding decision for dest
+static inline ForwardResult decide(uint32_t dest, int hop, const NextHopTable &hops) {
+    if (hop == NO_ROUTE) {
+        return {dest, 0, UNRESOLVED, FWD_NO_ROUTE};
+    }
+    if (hops.iface[hop] == UNRESOLVED) {
+        return {dest, hops.addrs[hop], UNRESOLVED, FWD_NO_INTERFACE};
+    }
+    if (hops.connected[hop]) {
+        return {dest, dest, hops.iface[hop], FWD_CONNECTED};
+    }
+    return {dest, hops.addrs[hop], hops.iface[hop], FWD_GATEWAY};
+}
+
+ForwardResult Fib::resolve(uint32_t dest) const {
+    return decide(dest, lookup(dest), hops);
+}
+
+void Fib::resolveBatch(const uint32_t *dests, ForwardResult *results, size_t n) const {
+    if (tracking) {
+        int32_t routes[LpmEngine::BATCH];
+        for (size_t start = 0; start < n; start += LpmEngine::BATCH) {
+            size_t count = std::min(n - start, (size_t) LpmEngine::BATCH);
+            resolveBatch(dests + start, results + start, routes, count);
+        }
+        return;
+    }
+
+    int hopIdx[LpmEngine::BATCH];
+    for (size_t start = 0; start < n; start += LpmEngine::BATCH) {
+        size_t count = std::min(n - start, (size_t) LpmEngine::BATCH);
+        engine->lookupBatch(dests + start, hopIdx, count);
+        for (size_t i = 0; i < count; i++) {
+            results[start + i] = decide(dests[start + i], hopIdx[i], hops);
+        }
+    }
+}
+
+void Fib::resolveBatch(const uint32_t *dests, ForwardResult *results, int32_t *routes, size_t n) const {
+    int value[LpmEngine::BATCH];
+    for (size_t start = 0; start < n; start += LpmEngine::BATCH) {
+        size_t count = std::min(n - start, (size_t) LpmEngine::BATCH);
+        engine->lookupBatch(dests + start, value, count);
+        for (size_t i = 0; i < count; i++) {
+            int v = value[i];
+            routes[start + i] = tracking && v != NO_ROUTE ? routeIds[v] : NO_ROUTE;
+            results[start + i] = decide(dests[start + i], hopOf(v), hops);
+        }
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef FIB_H
+#define FIB_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "lpm.h"
+#include "mmapfile.h"
+
+// How a destination was resolved
+enum ForwardStatus : int32_t {
+    FWD_GATEWAY = 0,       // leaves on iface towards the nextHop gateway
+    FWD_CONNECTED = 1,     // iface is on the destination's own subnet
+    FWD_NO_ROUTE = 2,      // no prefix covers the destination
+    FWD_NO_INTERFACE = 3,  // the route's next hop is not on any interface subnet
+};
+
+// One forwarding decision, fixed size so batches can be handed around as arrays
+struct ForwardResult {
+    uint32_t dest;
+    uint32_t nextHop;  // the destination itself for connected subnets
+    int32_t iface;     // index into interfaceTable(), or UNRESOLVED
+    int32_t status;    // a ForwardStatus
+};
+
+// A prefix as the statistics know it. Route ids are handed out as prefixes
+// enter the table and are never reused, so counts survive withdrawals.
+struct TrackedRoute {
+    uint32_t network;
+    uint8_t maskLen;
+    bool connected;
+};
+
+// Interfaces as parallel arrays, with every name in one string table
+struct InterfaceTable {
+    std::vector<uint32_t> ip;
+    std::vector<uint32_t> network;
+    std::vector<uint8_t> maskLen;
+    std::vector<uint32_t> nameStart;  // offset of each name in names, plus an end marker
+    std::string names;
+
+    size_t size() const { return ip.size(); }
+    std::string_view name(size_t i) const { return std::string_view(names).substr(nameStart[i], nameStart[i + 1] - nameStart[i]); }
+    void clear();
+    void add(const InterfaceEntry &e);
+};
+
+// Forwarding information base. Interface subnets go in as connected prefixes
+// next to the static routes, so a single longest prefix match answers both
+// "deliver locally" and "forward to a gateway".
+class Fib {
+public:
+    // Have the engine answer with prefix positions rather than next hops, so
+    // the route behind every decision is known. Set before build() or load().
+    void setRouteTracking(bool on) { tracking = on; }
+    bool routeTracking() const { return tracking; }
+
+    // Build from the parsed files using the given lookup engine, on up to
+    // threads threads for large tables
+    bool build(std::vector<InterfaceEntry> ifs, const std::vector<RouteEntry> &routes, std::unique_ptr<LpmEngine> lpm,
+               int threads = 1);
+
+    // Write the built FIB, engine tables included, to a snapshot file
+    bool save(const std::string &path) const;
+
+    // The snapshot save() writes, as one block of memory
+    std::string snapshotImage() const;
+
+    // Load a snapshot written by save(). With lpmName "auto" the stored
+    // engine is used, in place inside the mapping when it supports that.
+    bool load(const std::string &path, const std::string &lpmName);
+
+    // load() for a snapshot image already in memory; owner, if given, keeps
+    // the memory alive for as long as the FIB may point into it. This also
+    // counts as a change for version(). On failure the FIB is left as it was.
+    bool attachImage(const char *base, size_t size, const std::string &lpmName, std::shared_ptr<MappedFile> owner);
+
+    // Independent copy with its own engine, built from the same prefixes
+    std::unique_ptr<Fib> clone() const;
+
+    // Install or replace the static route for network/maskLen. Engines that
+    // cannot change in place are rebuilt. False if the route was refused.
+    bool addRoute(uint32_t network, int maskLen, uint32_t nextHop);
+
+    // Withdraw the static route for network/maskLen, false if there is none
+    bool withdrawRoute(uint32_t network, int maskLen);
+
+    // Next hop index of the best prefix for dest, or NO_ROUTE
+    int lookup(uint32_t dest) const { return hopOf(engine->lookup(dest)); }
+
+    // Full forwarding decision for one destination
+    ForwardResult resolve(uint32_t dest) const;
+
+    // Forwarding decisions for dests[0..n) into results[0..n). The engine
+    // works on several lookups at once to overlap their memory accesses.
+    void resolveBatch(const uint32_t *dests, ForwardResult *results, size_t n) const;
+
+    // resolveBatch() that also stores the id of the matching route, an index
+    // into trackedRoutes(), or NO_ROUTE. Ids are only known with tracking.
+    void resolveBatch(const uint32_t *dests, ForwardResult *results, int32_t *routes, size_t n) const;
+
+    const std::vector<TrackedRoute> &trackedRoutes() const { return routeNames; }
+
+    // Changes made by addRoute() and withdrawRoute(), to tell when cached
+    // decisions are stale. Copies that saw the same changes agree.
+    uint64_t version() const { return changes; }
+
+    const LpmEngine &lpm() const { return *engine; }
+    const NextHopTable &nextHops() const { return hops; }
+    const InterfaceTable &interfaceTable() const { return interfaces; }
+    const PrefixTable &prefixTable() const { return prefixes; }
+
+private:
+    static uint64_t prefixKey(uint32_t network, int maskLen) { return (uint64_t) network << 8 | (uint64_t) maskLen; }
+
+    // Recreate prefixIndex from the prefix table
+    void indexPrefixes();
+
+    // Pass one prefix change on to the engine. With tracking, the prefix that
+    // moved into a withdrawn prefix's position is passed on as well. Engines
+    // without an in place update (linear, simd, poptrie) rebuild from the
+    // whole table on every change.
+    bool updateEngine(uint32_t network, int maskLen, int value, size_t moved = SIZE_MAX);
+
+    // Build e from the prefixes, numbered by position when tracking routes
+    bool buildEngine(LpmEngine &e, int threads = 1) const;
+
+    // Make e the engine and build it, or the trie when e cannot hold the values
+    bool installEngine(std::unique_ptr<LpmEngine> e, int threads = 1);
+
+    // Distinct values the engine is given: prefix positions or next hops
+    size_t valueCount() const { return tracking ? prefixes.size() : hops.addrs.size(); }
+
+    // Which routes enter the table: not inside a connected subnet and the
+    // first of their prefix. Threads split the work by prefix hash.
+    std::vector<uint8_t> selectRoutes(const std::vector<RouteEntry> &routes, int threads) const;
+
+    // Give every prefix a fresh route id
+    void assignRouteIds();
+
+    // Next hop index for a value the engine returned
+    int hopOf(int value) const { return tracking && value != NO_ROUTE ? prefixes.hop[value] : value; }
+
+    InterfaceTable interfaces;
+    PrefixTable prefixes;
+    NextHopTable hops;
+    std::unique_ptr<LpmEngine> engine;
+    std::shared_ptr<MappedFile> mapping;  // shared by the copies that attached it
+    std::unordered_map<uint64_t, uint32_t> prefixIndex;  // prefixKey() to position in prefixes
+    uint64_t changes = 0;
+
+    bool tracking = false;
+    std::vector<int32_t> routeIds;          // by prefix position, with tracking
+    std::vector<TrackedRoute> routeNames;   // by route id
+};
+
+#endif
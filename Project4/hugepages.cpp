@@ -0,0 +1,159 @@
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hugepages.h"
+#include "logging.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace {
+
+constexpr size_t GIGA_PAGE = (size_t) 1 << 30;
+
+std::atomic<bool> enabled{false};
+
+// Blocks that were mapped here rather than taken from the heap
+struct Block {
+    size_t length;
+    bool hugetlb;
+};
+std::mutex lock;
+std::unordered_map<void *, Block> blocks;
+uint64_t hugetlbBytes = 0;
+uint64_t advisedBytes = 0;
+bool warned = false;
+
+size_t roundUp(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+void *mapHugetlb(size_t length, size_t page) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+    if (page == GIGA_PAGE) {
+        flags |= 30 << MAP_HUGE_SHIFT;
+    }
+    void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+}
+
+// Anonymous memory on a 2 MB boundary, so transparent huge pages can cover
+// all of it, with the overhang on either side given back
+void *mapAligned(size_t length) {
+    size_t span = length + HUGE_MIN;
+    void *p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    char *start = static_cast<char *>(p);
+    char *aligned = reinterpret_cast<char *>(roundUp(reinterpret_cast<uintptr_t>(start), HUGE_MIN));
+    if (aligned > start) {
+        munmap(start, aligned - start);
+    }
+    munmap(aligned + length, start + span - (aligned + length));
+    return aligned;
+}
+
+// First number on the line of a /proc file starting with key, or 0
+uint64_t procValue(const char *path, const std::string &key) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, key.size(), key) == 0) {
+            return std::strtoull(line.c_str() + key.size(), nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+}
+
+void setHugePages(bool on) {
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+bool hugePagesEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void *hugeAllocate(size_t bytes) {
+    if (!hugePagesEnabled() || bytes < HUGE_MIN) {
+        return ::operator new(bytes);
+    }
+
+    size_t page = bytes >= GIGA_PAGE ? GIGA_PAGE : HUGE_MIN;
+    size_t length = roundUp(bytes, page);
+    void *p = mapHugetlb(length, page);
+    if (!p && page == GIGA_PAGE) {
+        page = HUGE_MIN;
+        length = roundUp(bytes, page);
+        p = mapHugetlb(length, page);
+    }
+    bool hugetlb = p != nullptr;
+    if (!p) {
+        p = mapAligned(length);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        madvise(p, length, MADV_HUGEPAGE);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    blocks[p] = {length, hugetlb};
+    (hugetlb ? hugetlbBytes : advisedBytes) += length;
+    if (!hugetlb && !warned) {
+        warned = true;
+        DEBUG << "No explicit huge pages free, using transparent huge pages." << ENDL;
+    }
+    return p;
+}
+
+void hugeFree(void *p, size_t bytes) {
+    if (!p) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = blocks.find(p);
+        if (it != blocks.end()) {
+            Block b = it->second;
+            blocks.erase(it);
+            (b.hugetlb ? hugetlbBytes : advisedBytes) -= b.length;
+            munmap(p, b.length);
+            return;
+        }
+    }
+    ::operator delete(p, bytes);
+}
+
+void adviseHugePages(const void *addr, size_t bytes) {
+    if (!hugePagesEnabled() || bytes < HUGE_MIN) {
+        return;
+    }
+    // madvise wants a page aligned start, which a mapping always has
+    madvise(const_cast<void *>(addr), bytes, MADV_HUGEPAGE);
+}
+
+HugePageReport hugePageReport() {
+    HugePageReport r;
+    r.enabled = hugePagesEnabled();
+    r.basePage = (size_t) sysconf(_SC_PAGESIZE);
+    r.hugePage = (size_t) procValue("/proc/meminfo", "Hugepagesize:") << 10;
+    r.hugetlbFree = procValue("/proc/meminfo", "HugePages_Free:");
+    r.anonHugeBytes = procValue("/proc/self/smaps_rollup", "AnonHugePages:") << 10;
+    r.shmemHugeBytes = procValue("/proc/self/smaps_rollup", "ShmemPmdMapped:") << 10;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        r.hugetlbBytes = hugetlbBytes;
+        r.advisedBytes = advisedBytes;
+    }
+    std::ifstream mode("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::getline(mode, r.transparent);
+    return r;
+}
@@ -0,0 +1,70 @@
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+// Huge page backing for the large lookup tables, for --hugepages. A random
+// destination stream touches a new 4K page on nearly every lookup in a
+// 32 MB dir24 table, so most of the lookup time goes to TLB misses; with
+// 2 MB pages the whole table needs a handful of TLB entries.
+//
+// Blocks of at least HUGE_MIN bytes first try explicit huge pages
+// (MAP_HUGETLB, 1 GB ones for blocks that size), which only exist when the
+// administrator reserved some. Otherwise the block is 2 MB aligned and
+// madvised for transparent huge pages, which the kernel may or may not
+// grant. Smaller blocks, and all of them while huge pages are off, come
+// from the ordinary heap.
+
+constexpr size_t HUGE_MIN = (size_t) 2 << 20;
+
+// Set once at startup, before any table is built
+void setHugePages(bool on);
+bool hugePagesEnabled();
+
+void *hugeAllocate(size_t bytes);
+void hugeFree(void *p, size_t bytes);
+
+// Ask for transparent huge pages on memory mapped elsewhere, such as a
+// shared FIB, when huge pages are on
+void adviseHugePages(const void *addr, size_t bytes);
+
+// What the tables got, for the stats dump
+struct HugePageReport {
+    bool enabled;
+    size_t basePage;         // the ordinary page size
+    size_t hugePage;         // the default huge page size
+    uint64_t hugetlbBytes;   // in explicit huge pages
+    uint64_t advisedBytes;   // madvised for transparent huge pages
+    uint64_t anonHugeBytes;  // of the whole process actually on transparent huge pages
+    uint64_t shmemHugeBytes; // of shared memory, such as a shared FIB, mapped with huge pages
+    uint64_t hugetlbFree;    // explicit huge pages still free in the system
+    std::string transparent; // the kernel's transparent huge page mode
+};
+HugePageReport hugePageReport();
+
+// Allocator for std::vector that goes through hugeAllocate()
+template <typename T>
+struct HugePageAllocator {
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(hugeAllocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { hugeFree(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const HugePageAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U> &) const { return false; }
+};
+
+template <typename T>
+using HugeVector = std::vector<T, HugePageAllocator<T>>;
+
+#endif
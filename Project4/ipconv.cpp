@@ -0,0 +1,212 @@
+#include <cstring>
+
+#include "ipconv.h"
+#include "parse.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IPCONV_SSE 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IPCONV_NEON 1
+#endif
+
+namespace {
+
+// Decimal text of every octet value, the length is kept in the last byte
+struct OctetText {
+    char text[4];
+};
+
+struct OctetTable {
+    OctetText entry[256];
+
+    constexpr OctetTable() : entry() {
+        for (int v = 0; v < 256; v++) {
+            int n = 0;
+            if (v >= 100) {
+                entry[v].text[n++] = (char) ('0' + v / 100);
+            }
+            if (v >= 10) {
+                entry[v].text[n++] = (char) ('0' + v / 10 % 10);
+            }
+            entry[v].text[n++] = (char) ('0' + v % 10);
+            entry[v].text[3] = (char) n;
+        }
+    }
+};
+
+const OctetTable octets;
+
+#if defined(IPCONV_SSE) || defined(IPCONV_NEON)
+
+// Shuffles that move the digits of an address into four 4 byte lanes laid
+// out as hundreds, tens, ones, zero. There is one per combination of octet
+// widths (1 to 3 digits each), 81 in all. 0x80 selects a zero byte.
+struct ShuffleTable {
+    uint8_t pattern[81][16];
+
+    constexpr ShuffleTable() : pattern() {
+        for (int key = 0; key < 81; key++) {
+            int widths[4] = {key / 27 + 1, key / 9 % 3 + 1, key / 3 % 3 + 1, key % 3 + 1};
+            int start = 0;
+            for (int k = 0; k < 4; k++) {
+                for (int j = 0; j < 4; j++) {
+                    pattern[key][k * 4 + j] = 0x80;
+                }
+                for (int j = 0; j < widths[k]; j++) {
+                    pattern[key][k * 4 + 3 - widths[k] + j] = (uint8_t) (start + j);
+                }
+                start += widths[k] + 1;
+            }
+        }
+    }
+};
+
+const ShuffleTable shuffles;
+
+// Works out the shuffle for an address from the bitmask of its dots. Fails
+// unless there are exactly three dots separating groups of 1 to 3 digits.
+inline bool shuffleKey(uint32_t dots, int len, int &key) {
+    if (__builtin_popcount(dots) != 3) {
+        return false;
+    }
+    int d0 = __builtin_ctz(dots);
+    dots &= dots - 1;
+    int d1 = __builtin_ctz(dots);
+    dots &= dots - 1;
+    int d2 = __builtin_ctz(dots);
+
+    int w0 = d0, w1 = d1 - d0 - 1, w2 = d2 - d1 - 1, w3 = len - d2 - 1;
+    if (w0 < 1 || w0 > 3 || w1 < 1 || w1 > 3 || w2 < 1 || w2 > 3 || w3 < 1 || w3 > 3) {
+        return false;
+    }
+    key = (w0 - 1) * 27 + (w1 - 1) * 9 + (w2 - 1) * 3 + (w3 - 1);
+    return true;
+}
+
+#endif
+
+#ifdef IPCONV_SSE
+
+__attribute__((target("sse4.1")))
+bool parseSimd(const char *p, int &len, uint32_t &ip) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i digits = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    __m128i isDot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+
+    // The address runs up to the first byte that is neither a digit nor a dot
+    uint32_t run = (uint32_t) _mm_movemask_epi8(_mm_or_si128(isDigit, isDot));
+    len = __builtin_ctz(~run);
+    if (len < 7 || len > 15) {
+        return false;
+    }
+    uint32_t dots = (uint32_t) _mm_movemask_epi8(isDot) & ((1u << len) - 1);
+
+    int key;
+    if (!shuffleKey(dots, len, key)) {
+        return false;
+    }
+
+    // Per lane 100 * hundreds + 10 * tens + ones, then reject octets over 255
+    __m128i lanes = _mm_shuffle_epi8(digits, _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffles.pattern[key])));
+    __m128i pairs = _mm_maddubs_epi16(lanes, _mm_setr_epi8(100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1, 0));
+    __m128i values = _mm_madd_epi16(pairs, _mm_set1_epi16(1));
+    if (_mm_movemask_epi8(_mm_cmpgt_epi32(values, _mm_set1_epi32(255)))) {
+        return false;
+    }
+
+    __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(values, values), values);
+    ip = __builtin_bswap32((uint32_t) _mm_cvtsi128_si32(bytes));
+    return true;
+}
+
+bool haveSimd() {
+    static const bool supported = __builtin_cpu_supports("sse4.1");
+    return supported;
+}
+
+#elif defined(IPCONV_NEON)
+
+inline uint32_t movemask(uint8x16_t m) {
+    const uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t masked = vandq_u8(m, bits);
+    return (uint32_t) vaddv_u8(vget_low_u8(masked)) | ((uint32_t) vaddv_u8(vget_high_u8(masked)) << 8);
+}
+
+bool parseSimd(const char *p, int &len, uint32_t &ip) {
+    uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+    uint8x16_t digits = vsubq_u8(v, vdupq_n_u8('0'));
+    uint8x16_t isDigit = vcleq_u8(digits, vdupq_n_u8(9));
+    uint8x16_t isDot = vceqq_u8(v, vdupq_n_u8('.'));
+
+    uint32_t run = movemask(vorrq_u8(isDigit, isDot));
+    len = __builtin_ctz(~run);
+    if (len < 7 || len > 15) {
+        return false;
+    }
+    uint32_t dots = movemask(isDot) & ((1u << len) - 1);
+
+    int key;
+    if (!shuffleKey(dots, len, key)) {
+        return false;
+    }
+
+    uint8x16_t lanes = vqtbl1q_u8(digits, vld1q_u8(shuffles.pattern[key]));
+    const uint8x8_t weights = {100, 10, 1, 0, 100, 10, 1, 0};
+    uint16x8_t lo = vmull_u8(vget_low_u8(lanes), weights);
+    uint16x8_t hi = vmull_u8(vget_high_u8(lanes), weights);
+    uint16x8_t pairs = vpaddq_u16(lo, hi);
+    uint16x4_t values = vget_low_u16(vpaddq_u16(pairs, pairs));
+    if (vmaxv_u16(values) > 255) {
+        return false;
+    }
+
+    uint8x8_t bytes = vmovn_u16(vcombine_u16(values, values));
+    ip = __builtin_bswap32(vget_lane_u32(vreinterpret_u32_u8(bytes), 0));
+    return true;
+}
+
+bool haveSimd() {
+    return true;
+}
+
+#endif
+
+}
+
+size_t formatIPv4(uint32_t ip, char *buf) {
+    char *p = buf;
+    for (int shift = 24; shift > 0; shift -= 8) {
+        const OctetText &o = octets.entry[(ip >> shift) & 0xFF];
+        memcpy(p, o.text, 4);
+        p += o.text[3];
+        *p++ = '.';
+    }
+    const OctetText &o = octets.entry[ip & 0xFF];
+    memcpy(p, o.text, 4);
+    p += o.text[3];
+    return (size_t) (p - buf);
+}
+
+bool parseIPv4Fast(const char *&p, const char *end, uint32_t &ip) {
+#if defined(IPCONV_SSE) || defined(IPCONV_NEON)
+    int len;
+    if (end - p >= 16 && haveSimd() && parseSimd(p, len, ip)) {
+        p += len;
+        return true;
+    }
+#endif
+    return parseIPv4(p, end, ip);
+}
+
+const char *ipv4ParserName() {
+#if defined(IPCONV_SSE)
+    return haveSimd() ? "sse4.1" : "scalar";
+#elif defined(IPCONV_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
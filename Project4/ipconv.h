@@ -0,0 +1,34 @@
+#ifndef IPCONV_H
+#define IPCONV_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Allocation free dotted-quad conversion used on the per-packet path.
+
+// Bytes a caller buffer for formatIPv4() must have; the formatter stores
+// whole 4 byte table entries, so this is one more than the longest address
+constexpr size_t IPV4_BUF = 16;
+
+// Writes ip as a dotted quad into buf (not NUL terminated), returns the length
+size_t formatIPv4(uint32_t ip, char *buf);
+
+// Parses a dotted quad at p and moves p past it, same rules as parseIPv4() in
+// parse.h. Uses SSE4.1 or NEON when 16 bytes are readable from p, otherwise
+// or for anything unusual it falls back to the scalar parser.
+bool parseIPv4Fast(const char *&p, const char *end, uint32_t &ip);
+
+// Which parser parseIPv4Fast() dispatches to on this machine
+const char *ipv4ParserName();
+
+// Converts between host order and the little endian of the binary input and
+// output formats, either way round
+inline uint32_t littleEndian(uint32_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(v);
+#else
+    return v;
+#endif
+}
+
+#endif
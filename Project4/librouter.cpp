@@ -0,0 +1,148 @@
+#include "librouter.h"
+#include "hugepages.h"
+#include "output.h"
+
+bool Router::fail(const std::string &message) {
+    error = message;
+    return false;
+}
+
+bool Router::load(const std::string &interfacesPath, const std::string &routesPath, const RouterOptions &options) {
+    std::vector<InterfaceEntry> interfaces;
+    std::vector<RouteEntry> routes;
+    if (!parseInterfaces(interfacesPath, interfaces)) {
+        return fail("Could not open interface config file " + interfacesPath + ".");
+    }
+    if (!parseRoutes(routesPath, routes, options.threads)) {
+        return fail("Could not open route table file " + routesPath + ".");
+    }
+    return build(std::move(interfaces), routes, options);
+}
+
+bool Router::build(std::vector<InterfaceEntry> interfaces, const std::vector<RouteEntry> &routes, const RouterOptions &options) {
+    if (options.hugePages) {
+        setHugePages(true);
+    }
+    auto lpm = makeEngine(options.lpm, interfaces.size() + routes.size());
+    if (!lpm) {
+        return fail("Unknown lookup engine " + options.lpm + ".");
+    }
+    std::unique_ptr<Fib> fib(new Fib());
+    if (!fib->build(std::move(interfaces), routes, std::move(lpm), options.threads)) {
+        return fail("Could not build the " + options.lpm + " engine.");
+    }
+    fibs.reset(new Rcu<Fib>(std::move(fib)));
+    error.clear();
+    return true;
+}
+
+bool Router::loadSnapshot(const std::string &path, const std::string &lpm) {
+    std::unique_ptr<Fib> fib(new Fib());
+    if (!fib->load(path, lpm)) {
+        return fail("Could not load FIB snapshot " + path + ".");
+    }
+    fibs.reset(new Rcu<Fib>(std::move(fib)));
+    error.clear();
+    return true;
+}
+
+bool Router::save(const std::string &path) {
+    if (!fibs) {
+        return fail("No FIB is loaded.");
+    }
+    if (!fibs->current().save(path)) {
+        return fail("Could not write FIB snapshot " + path + ".");
+    }
+    return true;
+}
+
+ForwardResult Router::lookup(uint32_t dest) const {
+    if (!fibs) {
+        return {dest, 0, UNRESOLVED, FWD_NO_ROUTE};
+    }
+    const Fib *fib = fibs->acquire();
+    ForwardResult r = fib->resolve(dest);
+    fibs->release(fib);
+    return r;
+}
+
+void Router::lookupBatch(const uint32_t *dests, ForwardResult *results, size_t n) const {
+    if (!fibs) {
+        for (size_t i = 0; i < n; i++) {
+            results[i] = {dests[i], 0, UNRESOLVED, FWD_NO_ROUTE};
+        }
+        return;
+    }
+    const Fib *fib = fibs->acquire();
+    fib->resolveBatch(dests, results, n);
+    fibs->release(fib);
+}
+
+std::string Router::interfaceName(int32_t iface) const {
+    if (!fibs || iface < 0) {
+        return std::string();
+    }
+    // Updates only change routes, every copy has the same interfaces
+    const Fib *fib = fibs->acquire();
+    const InterfaceTable &ifs = fib->interfaceTable();
+    std::string name = (size_t) iface < ifs.size() ? std::string(ifs.name((size_t) iface)) : std::string();
+    fibs->release(fib);
+    return name;
+}
+
+std::string Router::format(const ForwardResult &r) const {
+    if (!fibs) {
+        return std::string();
+    }
+    OutputWriter out(OutputWriter::MEMORY_ONLY, 64);
+    const Fib *fib = fibs->acquire();
+    writeResult(r, *fib, out);
+    fibs->release(fib);
+    // Without the newline endLine() put there
+    return std::string(out.data(), out.size() - 1);
+}
+
+bool Router::change(std::function<bool(Fib &)> f, const std::string &message) {
+    if (!fibs) {
+        return fail("No FIB is loaded.");
+    }
+    // The change is replayed on the other copy later, which stores the same
+    // result again before the next change runs
+    fibs->modify([this, f](Fib &fib) { applied = f(fib); });
+    fibs->publish();
+    return applied || fail(message);
+}
+
+bool Router::addRoute(uint32_t network, int maskLen, uint32_t nextHop) {
+    std::string prefix = numToIP(network) + "/" + std::to_string(maskLen);
+    if (maskLen < 0 || maskLen > 32) {
+        return fail("Bad prefix length in " + prefix + ".");
+    }
+    return change([network, maskLen, nextHop](Fib &fib) { return fib.addRoute(network, maskLen, nextHop); },
+                  "Route " + prefix + " is inside a connected subnet.");
+}
+
+bool Router::withdrawRoute(uint32_t network, int maskLen) {
+    std::string prefix = numToIP(network) + "/" + std::to_string(maskLen);
+    if (maskLen < 0 || maskLen > 32) {
+        return fail("Bad prefix length in " + prefix + ".");
+    }
+    return change([network, maskLen](Fib &fib) { return fib.withdrawRoute(network, maskLen); },
+                  "There is no route " + prefix + " to withdraw.");
+}
+
+bool Router::applyUpdates(const std::string &path) {
+    // Read once, so the copy that catches up later gets the same updates
+    // even if the file changes in between
+    std::vector<RouteUpdate> updates;
+    if (!parseRouteUpdates(path, updates)) {
+        return fail("Could not open route update file " + path + ".");
+    }
+    // Lines that were refused are skipped, like -u does
+    return change([updates](Fib &fib) {
+        for (auto &u : updates) {
+            applyRouteUpdate(u.withdraw, u.route, fib);
+        }
+        return true;
+    }, std::string());
+}
@@ -0,0 +1,84 @@
+#ifndef LIBROUTER_H
+#define LIBROUTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "router.h"
+#include "fib.h"
+#include "rcu.h"
+
+// The forwarding logic of ./router for use inside another program, linked
+// from librouter.a (make librouter). Nothing here exits the process or
+// writes to stdout: a call that fails returns false and leaves the reason in
+// lastError(), with the details logged as ERROR messages like the router does.
+//
+// Set up with load(), build() or loadSnapshot() first; these replace any FIB
+// loaded before and must not overlap with lookups. After that lookups may
+// run on any number of threads, also while one thread at a time changes
+// routes; a change becomes visible to lookups that start after it returns.
+struct RouterOptions {
+    std::string lpm = "auto";  // lookup engine, as for --lpm
+    int threads = 1;           // for parsing and building large tables
+    bool hugePages = false;    // as for --hugepages, affects the whole process
+};
+
+class Router {
+public:
+    Router() = default;
+    Router(const Router &) = delete;
+    Router &operator=(const Router &) = delete;
+
+    // Parse an interface config and a route table and build the FIB from them
+    bool load(const std::string &interfacesPath, const std::string &routesPath, const RouterOptions &options = RouterOptions());
+
+    // Build the FIB from interfaces and routes already in memory
+    bool build(std::vector<InterfaceEntry> interfaces, const std::vector<RouteEntry> &routes,
+               const RouterOptions &options = RouterOptions());
+
+    // Map a snapshot written by ./router --compile or save()
+    bool loadSnapshot(const std::string &path, const std::string &lpm = "auto");
+
+    // Write the FIB as it is now to a snapshot file
+    bool save(const std::string &path);
+
+    bool loaded() const { return fibs != nullptr; }
+
+    // Forwarding decision for dest, FWD_NO_ROUTE before anything is loaded
+    ForwardResult lookup(uint32_t dest) const;
+
+    // Decisions for dests[0..n) into results[0..n), all from the same version
+    // of the routes. Faster per destination than lookup() on every one.
+    void lookupBatch(const uint32_t *dests, ForwardResult *results, size_t n) const;
+
+    // Name of the interface a result leaves on, empty for UNRESOLVED
+    std::string interfaceName(int32_t iface) const;
+
+    // A result as the line ./router prints for it, without the newline
+    std::string format(const ForwardResult &r) const;
+
+    // Install or replace, and withdraw, one static route
+    bool addRoute(uint32_t network, int maskLen, uint32_t nextHop);
+    bool withdrawRoute(uint32_t network, int maskLen);
+
+    // Apply a file of "+<prefix> <nextHop>" and "-<prefix>" lines, as for -u
+    bool applyUpdates(const std::string &path);
+
+    const std::string &lastError() const { return error; }
+
+private:
+    bool fail(const std::string &message);
+
+    // Apply f to the FIB copies and publish, false with message if f refused
+    bool change(std::function<bool(Fib &)> f, const std::string &message);
+
+    // Lookups register as readers through the pointer, so they stay const
+    std::unique_ptr<Rcu<Fib>> fibs;
+    bool applied = false;  // what the last change returned
+    std::string error;
+};
+
+#endif
@@ -5,27 +5,71 @@
 
     Use as if it were an I/O Stream, replacing std::cout << with the message level
     you desire and ending the line with EDNL rather than std::endl
+
+    Levels follow the -d numbering: FATAL 1, ERROR 2, WARNING 3, INFO 4,
+    DEBUG 5, TRACE 6. Build with -DROUTER_MIN_LOG_LEVEL=<n> to compile out
+    every message more verbose than level n, so e.g. 4 removes DEBUG and
+    TRACE from the binary entirely. Levels up to the floor are still picked
+    at run time with LOG_LEVEL.
+
+    Messages go to std::cerr unless startAsyncLog() from logsink.h has
+    switched them to the background file writer.
 */
 
 #ifndef LOGGING_H
 #define LOGGING_H
 
+#include <atomic>
 #include <iostream>
-#include <filesystem>
 #include <string>
 
+#ifndef ROUTER_MIN_LOG_LEVEL
+#define ROUTER_MIN_LOG_LEVEL 6
+#endif
+
+// Part of a path after the last '/', usable in constant expressions
+constexpr const char *logFileName(const char *path) {
+    const char *name = path;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/') {
+            name = p + 1;
+        }
+    }
+    return name;
+}
+
 #ifndef  __FILE_NAME__
-#define __FILE_NAME__ std::filesystem::path(__FILE__).filename().string()
+#define __FILE_NAME__ ([] { constexpr const char *name = logFileName(__FILE__); return name; }())
 #endif
 
+// Set while the asynchronous sink in logsink.cpp is running
+inline std::atomic<bool> LOG_ASYNC{false};
+std::ostream &asyncLogStream();
+void asyncLogCommit();
+
+// One message, handed to its destination when the statement ends
+struct LogRecord {
+    std::ostream &stream;
+    LogRecord() : stream(LOG_ASYNC.load(std::memory_order_relaxed) ? asyncLogStream() : std::cerr) {}
+    ~LogRecord() {
+        if (&stream == &std::cerr) {
+            stream << std::endl;
+        } else {
+            asyncLogCommit();
+        }
+    }
+};
+
+#define LOG_AT(level, tag) if constexpr ((level) <= ROUTER_MIN_LOG_LEVEL) if (LOG_LEVEL >= (level)) { LogRecord logRecord_; logRecord_.stream << tag
+
 inline int LOG_LEVEL = 3;
-#define TRACE   if (LOG_LEVEL > 5) { std::cerr << "TRACE: "
-#define DEBUG   if (LOG_LEVEL > 4) { std::cerr << "DEBUG: "
-#define INFO    if (LOG_LEVEL > 3) { std::cerr << "INFO: "
-#define WARNING if (LOG_LEVEL > 2) { std::cerr << "WARNING: "
-#define ERROR   if (LOG_LEVEL > 1) { std::cerr << "ERROR: "
-#define FATAL   if (LOG_LEVEL > 0) { std::cerr << "FATAL: "
-#define ENDL  " (" << __FILE_NAME__ << ":" << __LINE__ << ")" << std::endl; }
+#define TRACE   LOG_AT(6, "TRACE: ")
+#define DEBUG   LOG_AT(5, "DEBUG: ")
+#define INFO    LOG_AT(4, "INFO: ")
+#define WARNING LOG_AT(3, "WARNING: ")
+#define ERROR   LOG_AT(2, "ERROR: ")
+#define FATAL   LOG_AT(1, "FATAL: ")
+#define ENDL  " (" << __FILE_NAME__ << ":" << __LINE__ << ")"; }
 
 
-#endif //LOGGING_H
\ No newline at end of file
+#endif
@@ -0,0 +1,230 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include "logsink.h"
+#include "logging.h"
+
+namespace {
+
+constexpr size_t RECORD_SIZE = 256;
+constexpr size_t MAX_RINGS = 256;
+
+struct Record {
+    uint32_t length;
+    char text[RECORD_SIZE - sizeof(uint32_t)];
+};
+
+// Single producer (the owning thread), single consumer (the drain thread).
+// Rings are never freed, so a thread that is still logging while the sink
+// stops cannot write into freed memory. A thread's ring goes to the next
+// thread that needs one once it exits.
+struct Ring {
+    explicit Ring(size_t capacity) : slots(capacity) {}
+
+    std::vector<Record> slots;
+    alignas(64) std::atomic<size_t> head{0};  // next slot the producer fills
+    std::atomic<bool> busy{false};            // the producer is committing a message
+    alignas(64) std::atomic<size_t> tail{0};  // next slot the consumer reads
+    alignas(64) std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> owned{true};            // a living thread logs to it
+};
+
+// Formats one message straight into a fixed buffer, longer text is cut off
+class RecordBuf : public std::streambuf {
+public:
+    RecordBuf() { reset(); }
+    void reset() { setp(text, text + sizeof(text)); }
+    const char *data() const { return text; }
+    size_t size() const { return (size_t) (pptr() - pbase()); }
+
+protected:
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+
+private:
+    char text[sizeof(Record::text)];
+};
+
+struct ThreadLog {
+    ~ThreadLog() {
+        if (ring) {
+            ring->owned.store(false, std::memory_order_release);
+        }
+    }
+
+    RecordBuf buf;
+    std::ostream stream{&buf};
+    Ring *ring = nullptr;
+};
+
+std::mutex registryLock;
+Ring *rings[MAX_RINGS];
+std::atomic<size_t> ringCount{0};
+std::atomic<uint64_t> unregistered{0};
+size_t ringCapacity = 0;
+
+FILE *logFile = nullptr;
+std::thread drainer;
+std::atomic<bool> stopping{false};
+
+thread_local ThreadLog threadLog;
+
+Ring *ringForThread() {
+    ThreadLog &t = threadLog;
+    if (t.ring) {
+        return t.ring;
+    }
+
+    // First message from this thread. A ring left by a thread that exited is
+    // taken over with whatever it still holds, the drain thread keeps going.
+    std::lock_guard<std::mutex> guard(registryLock);
+    size_t n = ringCount.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < n; i++) {
+        bool owned = false;
+        if (rings[i]->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+            t.ring = rings[i];
+            return t.ring;
+        }
+    }
+    if (n < MAX_RINGS) {
+        rings[n] = new Ring(ringCapacity);
+        t.ring = rings[n];
+        ringCount.store(n + 1, std::memory_order_release);
+    }
+    return t.ring;
+}
+
+// Writes out all complete records of every ring, returns how many it wrote
+size_t drainOnce() {
+    size_t written = 0;
+    size_t n = ringCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        Ring *ring = rings[i];
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            const Record &r = ring->slots[tail % ring->slots.size()];
+            fwrite(r.text, 1, r.length, logFile);
+            fputc('\n', logFile);
+            written++;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+    return written;
+}
+
+void drainLoop() {
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (drainOnce() == 0) {
+            fflush(logFile);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    drainOnce();
+    fflush(logFile);
+}
+
+}
+
+std::ostream &asyncLogStream() {
+    threadLog.buf.reset();
+    return threadLog.stream;
+}
+
+// A message started while the sink ran but finished after it stopped
+static void writeSynchronously() {
+    std::cerr.write(threadLog.buf.data(), (std::streamsize) threadLog.buf.size());
+    std::cerr << std::endl;
+}
+
+void asyncLogCommit() {
+    Ring *ring = ringForThread();
+    if (!ring) {
+        if (!LOG_ASYNC.load(std::memory_order_seq_cst)) {
+            writeSynchronously();
+        } else {
+            unregistered.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // stopAsyncLog() clears LOG_ASYNC and then waits for busy rings, so
+    // either this sees the sink stopped or the message is in before the
+    // last drain
+    ring->busy.store(true, std::memory_order_seq_cst);
+    if (!LOG_ASYNC.load(std::memory_order_seq_cst)) {
+        ring->busy.store(false, std::memory_order_release);
+        writeSynchronously();
+        return;
+    }
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= ring->slots.size()) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        Record &r = ring->slots[head % ring->slots.size()];
+        r.length = (uint32_t) threadLog.buf.size();
+        memcpy(r.text, threadLog.buf.data(), r.length);
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+    ring->busy.store(false, std::memory_order_release);
+}
+
+bool startAsyncLog(const std::string &path, size_t recordsPerThread) {
+    stopAsyncLog();
+    logFile = fopen(path.c_str(), "w");
+    if (!logFile) {
+        return false;
+    }
+    {
+        // Rings that exist keep their size, new ones get recordsPerThread
+        std::lock_guard<std::mutex> guard(registryLock);
+        ringCapacity = recordsPerThread;
+        size_t n = ringCount.load();
+        for (size_t i = 0; i < n; i++) {
+            rings[i]->dropped.store(0);
+        }
+    }
+    stopping.store(false);
+    unregistered.store(0);
+    drainer = std::thread(drainLoop);
+    LOG_ASYNC.store(true, std::memory_order_release);
+    return true;
+}
+
+void stopAsyncLog() {
+    if (!logFile) {
+        return;
+    }
+    // Messages committed from here on go to std::cerr. Those being put in
+    // a ring right now are waited for, so the last drain writes them.
+    LOG_ASYNC.store(false, std::memory_order_seq_cst);
+    size_t n = ringCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        while (rings[i]->busy.load(std::memory_order_seq_cst)) {
+            std::this_thread::yield();
+        }
+    }
+    stopping.store(true, std::memory_order_release);
+    drainer.join();
+
+    uint64_t dropped = asyncLogDropped();
+    if (dropped) {
+        fprintf(logFile, "WARNING: %llu log messages dropped, ring buffers were full.\n", (unsigned long long) dropped);
+    }
+    fclose(logFile);
+    logFile = nullptr;
+}
+
+uint64_t asyncLogDropped() {
+    uint64_t total = unregistered.load(std::memory_order_relaxed);
+    size_t n = ringCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        total += rings[i]->dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
@@ -0,0 +1,23 @@
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include <cstdint>
+#include <string>
+
+// Optional asynchronous backend for the logging.h macros. While it runs,
+// each thread appends finished messages to its own lock-free ring buffer and
+// a background thread drains every ring to the log file. A producer never
+// waits: when its ring is full the message is dropped and counted.
+
+// Start sending log messages to path, false if the file cannot be opened
+bool startAsyncLog(const std::string &path, size_t recordsPerThread = 4096);
+
+// Drain whatever is left, stop the background thread and go back to std::cerr.
+// Other threads may keep logging during and after the call, messages they
+// finish once it started go to std::cerr. Start and stop from one thread.
+void stopAsyncLog();
+
+// Messages dropped because a ring was full, since startAsyncLog()
+uint64_t asyncLogDropped();
+
+#endif
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cctype>
+#include "lpm.h"
+#include "trie.h"
+#include "dir24.h"
+#include "simd.h"
+#include "poptrie.h"
+
+void NextHopTable::clear() {
+    addrs.clear();
+    iface.clear();
+    connected.clear();
+    gateways.clear();
+}
+
+int NextHopTable::addConnected(int ifaceIdx) {
+    addrs.push_back(0);
+    iface.push_back(ifaceIdx);
+    connected.push_back(true);
+    return (int) addrs.size() - 1;
+}
+
+int NextHopTable::addGateway(uint32_t addr) {
+    auto it = gateways.find(addr);
+    if (it != gateways.end()) {
+        return it->second;
+    }
+    addrs.push_back(addr);
+    iface.push_back(UNRESOLVED);
+    connected.push_back(false);
+    gateways.emplace(addr, (int) addrs.size() - 1);
+    return (int) addrs.size() - 1;
+}
+
+void NextHopTable::resolve(std::vector<InterfaceEntry> &interfaces) {
+    for (size_t i = 0; i < addrs.size(); i++) {
+        if (connected[i]) {
+            continue;
+        }
+        InterfaceEntry *out = findOutgoingInterface(addrs[i], interfaces);
+        if (out) {
+            iface[i] = (int) (out - interfaces.data());
+        } else {
+            WARNING << "Next hop " << numToIP(addrs[i]) << " is not on any interface subnet." << ENDL;
+        }
+    }
+}
+
+void NextHopTable::reindex() {
+    gateways.clear();
+    for (size_t i = 0; i < addrs.size(); i++) {
+        if (!connected[i]) {
+            gateways.emplace(addrs[i], (int) i);
+        }
+    }
+}
+
+void PrefixTable::clear() {
+    network.clear();
+    mask.clear();
+    maskLen.clear();
+    hop.clear();
+}
+
+void PrefixTable::reserve(size_t n) {
+    network.reserve(n);
+    mask.reserve(n);
+    maskLen.reserve(n);
+    hop.reserve(n);
+}
+
+void PrefixTable::add(uint32_t net, int len, int nextHop) {
+    uint32_t m = len == 0 ? 0 : 0xFFFFFFFF << (32 - len);
+    network.push_back(net & m);
+    mask.push_back(m);
+    maskLen.push_back((uint8_t) len);
+    hop.push_back(nextHop);
+}
+
+void PrefixTable::removeAt(size_t i) {
+    size_t last = size() - 1;
+    network[i] = network[last];
+    mask[i] = mask[last];
+    maskLen[i] = maskLen[last];
+    hop[i] = hop[last];
+    network.pop_back();
+    mask.pop_back();
+    maskLen.pop_back();
+    hop.pop_back();
+}
+
+bool LinearEngine::build(const PrefixTable &prefixes) {
+    table = prefixes;
+    return true;
+}
+
+int LinearEngine::lookup(uint32_t dest) const {
+    int best = NO_ROUTE;
+    int bestMask = -1;
+
+    // Same rule as findRoute(): longest mask wins, the first one on ties
+    for (size_t i = 0; i < table.size(); i++) {
+        if ((dest & table.mask[i]) == table.network[i] && table.maskLen[i] > bestMask) {
+            bestMask = table.maskLen[i];
+            best = table.hop[i];
+        }
+    }
+    return best;
+}
+
+size_t LinearEngine::memoryUsage() const {
+    return table.size() * (2 * sizeof(uint32_t) + sizeof(uint8_t) + sizeof(int32_t));
+}
+
+std::unique_ptr<LpmEngine> makeEngine(const std::string &name, size_t expectedPrefixes) {
+    if (name == "auto") {
+        return makeEngine(expectedPrefixes < SimdLinearEngine::AUTO_THRESHOLD ? "simd" : "trie");
+    } else if (name == "linear") {
+        return std::unique_ptr<LpmEngine>(new LinearEngine());
+    } else if (name == "simd") {
+        return std::unique_ptr<LpmEngine>(new SimdLinearEngine());
+    } else if (name == "trie") {
+        return std::unique_ptr<LpmEngine>(new RouteTrie());
+    } else if (name == "dir24") {
+        return std::unique_ptr<LpmEngine>(new Dir24Table());
+    } else if (name == "poptrie") {
+        return std::unique_ptr<LpmEngine>(new PopTrie());
+    } else if (name.rfind("poptrie:", 0) == 0 && name.size() > 8 && name.size() <= 10 &&
+               std::all_of(name.begin() + 8, name.end(), ::isdigit) && std::stoi(name.substr(8)) <= PopTrie::MAX_DIRECT_BITS) {
+        return std::unique_ptr<LpmEngine>(new PopTrie(std::stoi(name.substr(8))));
+    }
+    return nullptr;
+}
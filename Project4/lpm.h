@@ -0,0 +1,139 @@
+#ifndef LPM_H
+#define LPM_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "router.h"
+
+// Lookup result when no prefix covers the destination
+constexpr int NO_ROUTE = -1;
+
+// Outgoing interface of a next hop that no interface subnet contains
+constexpr int UNRESOLVED = -1;
+
+// Prefixes that share a next hop share one small index, so the lookup engines
+// can store that index per prefix instead of a copy of the RouteEntry.
+// Connected next hops forward to the destination itself on their interface.
+struct NextHopTable {
+    std::vector<uint32_t> addrs;    // gateway address, by next hop index
+    std::vector<int> iface;         // outgoing interface index or UNRESOLVED, by next hop index
+    std::vector<bool> connected;    // hop delivers on the interface subnet, by next hop index
+
+    void clear();
+
+    // Next hop for a subnet directly attached to interface ifaceIdx
+    int addConnected(int ifaceIdx);
+
+    // Next hop through a gateway, deduplicated by address
+    int addGateway(uint32_t addr);
+
+    // Bind every gateway to its outgoing interface once after loading
+    void resolve(std::vector<InterfaceEntry> &interfaces);
+
+    // Recreate the gateway index after the arrays were filled directly
+    void reindex();
+
+private:
+    std::unordered_map<uint32_t, int> gateways;
+};
+
+// Lookup side of the FIB as parallel arrays, one element per prefix, so a
+// scan only pulls the fields it compares into cache. Engines build from this.
+struct PrefixTable {
+    std::vector<uint32_t> network;  // already masked
+    std::vector<uint32_t> mask;     // netmask, 0 for /0
+    std::vector<uint8_t> maskLen;
+    std::vector<int32_t> hop;       // next hop index
+
+    size_t size() const { return network.size(); }
+    void clear();
+    void reserve(size_t n);
+    void add(uint32_t net, int len, int nextHop);
+
+    // Remove prefix i by moving the last prefix into its place
+    void removeAt(size_t i);
+};
+
+// Common interface of the longest prefix match engines selectable with --lpm
+class LpmEngine {
+public:
+    virtual ~LpmEngine() = default;
+
+    virtual const char *name() const = 0;
+
+    // Build from the FIB prefixes, false if the table cannot be represented
+    virtual bool build(const PrefixTable &prefixes) = 0;
+
+    // build() with the work spread over up to threads threads. Engines that
+    // have no way to split it up build on the calling thread.
+    virtual bool buildParallel(const PrefixTable &prefixes, int threads) {
+        (void) threads;
+        return build(prefixes);
+    }
+
+    // Next hop index of the longest matching prefix, or NO_ROUTE
+    virtual int lookup(uint32_t dest) const = 0;
+
+    // Largest batch callers should pass to lookupBatch() at once
+    static constexpr size_t BATCH = 256;
+
+    // lookup() for dests[0..n) into hops[0..n). Engines override this to
+    // interleave the lookups and prefetch the memory the next steps need.
+    virtual void lookupBatch(const uint32_t *dests, int *hops, size_t n) const {
+        for (size_t i = 0; i < n; i++) {
+            hops[i] = lookup(dests[i]);
+        }
+    }
+
+    // Approximate bytes used by the lookup structure
+    virtual size_t memoryUsage() const = 0;
+
+    // How many distinct values build() and update() take, 0 to limit - 1
+    virtual size_t valueLimit() const { return SIZE_MAX; }
+
+    // Point prefix/maskLen at next hop index hop in place, or withdraw it when
+    // hop is NO_ROUTE. False if the engine cannot, and has to be rebuilt.
+    virtual bool update(uint32_t prefix, int maskLen, int hop) {
+        (void) prefix;
+        (void) maskLen;
+        (void) hop;
+        return false;
+    }
+
+    // Flat arrays that make up the built structure, for FIB snapshots. An
+    // engine that returns none is rebuilt from the prefixes when loaded.
+    virtual std::vector<std::pair<const void *, size_t>> exportArrays() const { return {}; }
+
+    // Use arrays from exportArrays() in place (e.g. inside a mapped snapshot)
+    // instead of building. The memory must outlive the engine. False unless
+    // every index in the arrays is in range and every value lookups can
+    // return is NO_ROUTE or below values, so nothing is read out of bounds.
+    virtual bool attachArrays(const std::vector<std::pair<const void *, size_t>> &arrays, size_t values) {
+        (void) arrays;
+        (void) values;
+        return false;
+    }
+};
+
+// Reference engine, the findRoute() scan over the packed prefix arrays
+class LinearEngine : public LpmEngine {
+public:
+    const char *name() const override { return "linear"; }
+    bool build(const PrefixTable &prefixes) override;
+    int lookup(uint32_t dest) const override;
+    size_t memoryUsage() const override;
+
+private:
+    PrefixTable table;
+};
+
+// Creates the engine called name ("linear", "simd", "trie", "dir24",
+// "poptrie" or "poptrie:<directBits>"), nullptr if unknown. "auto" picks
+// simd when expectedPrefixes is small and the trie for anything larger.
+std::unique_ptr<LpmEngine> makeEngine(const std::string &name, size_t expectedPrefixes = 0);
+
+#endif
@@ -0,0 +1,538 @@
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "router.h"
+#include "parse.h"
+#include "ipconv.h"
+#include "fib.h"
+#include "hugepages.h"
+#include "mmapfile.h"
+#include "output.h"
+#include "parallel.h"
+#include "rcu.h"
+#include "routecache.h"
+#include "logsink.h"
+#include "server.h"
+#include "sharedfib.h"
+#include "stats.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Set by SIGUSR1 to ask for a statistics dump while running
+static volatile sig_atomic_t statsRequested = 0;
+
+static void requestStats(int) {
+    statsRequested = 1;
+}
+
+// Set by SIGINT or SIGTERM to end --serve
+static volatile sig_atomic_t stopServing = 0;
+
+static void requestStop(int) {
+    stopServing = 1;
+}
+
+static double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    auto started = Clock::now();
+
+    std::string configFile, routeFile, inputFile, outputFile, logFile, fibFile, updateFile, statsFile, serveAddr, shmName, shmPublish;
+    std::string lpmName = "auto";
+    bool useMmap = false;
+    bool compile = false;
+    bool hugePages = false;
+    bool binaryIn = false;
+    bool binaryOut = false;
+    long flushEvery = -1;
+    size_t cacheEntries = 0;
+    int threads = 1;
+    int loadThreads = std::max(1, (int) std::thread::hardware_concurrency());
+    int debugLevel = 4;
+
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "-h") {
+            std::cout << "Usage: ./router -c <configFile> -r <routeTable> | -f <fibSnapshot> | --shm=<name> [-u <updateFile>] [-i <inputFile>] [-o <outputFile>] [-d <debugLevel>] [-j <threads>] [--load-threads=<n>] [--lpm=<auto|linear|simd|trie|dir24|poptrie>] [--mmap] [--hugepages] [--flush-every=<lines>] [--line-buffered] [--log-file=<path>] [--route-cache=<entries>] [--stats=<file>] [--serve=<socketPath|udpPort>] [--in-format=<text|bin>] [--out-format=<text|bin>] [--compile] [--shm-publish=<name>] [-h]\nDefault for input and output is stdin and stdout.\n       ./router --compile -c <configFile> -r <routeTable> -o <fibSnapshot> writes a snapshot for -f.\n       ./router --shm-publish=<name> -c <configFile> -r <routeTable> publishes a FIB for --shm." << std::endl;
+            return 0;
+        }
+
+        // Long options carry their value in the same argument
+        if (flag.rfind("--", 0) == 0) {
+            if (flag.rfind("--lpm=", 0) == 0) {
+                lpmName = flag.substr(6);
+            } else if (flag.rfind("--load-threads=", 0) == 0) {
+                loadThreads = std::max(1, std::stoi(flag.substr(15)));
+            } else if (flag == "--mmap") {
+                useMmap = true;
+            } else if (flag == "--hugepages") {
+                hugePages = true;
+            } else if (flag == "--compile") {
+                compile = true;
+            } else if (flag.rfind("--flush-every=", 0) == 0) {
+                flushEvery = std::stol(flag.substr(14));
+            } else if (flag == "--line-buffered") {
+                flushEvery = 1;
+            } else if (flag.rfind("--route-cache=", 0) == 0) {
+                cacheEntries = std::stoul(flag.substr(14));
+            } else if (flag.rfind("--log-file=", 0) == 0) {
+                logFile = flag.substr(11);
+            } else if (flag.rfind("--stats=", 0) == 0) {
+                statsFile = flag.substr(8);
+            } else if (flag.rfind("--shm=", 0) == 0) {
+                shmName = flag.substr(6);
+            } else if (flag.rfind("--shm-publish=", 0) == 0) {
+                shmPublish = flag.substr(14);
+            } else if (flag.rfind("--serve=", 0) == 0) {
+                serveAddr = flag.substr(8);
+            } else if (flag == "--in-format=text" || flag == "--in-format=bin") {
+                binaryIn = flag == "--in-format=bin";
+            } else if (flag == "--out-format=text" || flag == "--out-format=bin") {
+                binaryOut = flag == "--out-format=bin";
+            } else {
+                std::cout << "Unknown flag received, or one or more flags are missing their arguments. Use -h to see valid options." << std::endl;
+                return -1;
+            }
+            continue;
+        }
+
+        if (i + 1 < argc) {
+            std::string arg = argv[i + 1];
+
+            if (flag == "-c") {
+                configFile = arg;
+            } else if (flag == "-r") {
+                routeFile = arg;
+            } else if (flag == "-i") {
+                inputFile = arg;
+            } else if (flag == "-o") {
+                outputFile = arg;
+            } else if (flag == "-f") {
+                fibFile = arg;
+            } else if (flag == "-u") {
+                updateFile = arg;
+            } else if (flag == "-d") {
+                debugLevel = std::stoi(arg);
+            } else if (flag == "-j") {
+                threads = std::max(1, std::stoi(arg));
+            } else {
+                std::cout << "Unknown flag received, or one or more flags are missing their arguments. Use -h to see valid options." << std::endl;
+                return -1;
+            }
+        }
+
+        i++; // Must double increment to get the next flag
+    }
+
+    // Set debug logging level
+    LOG_LEVEL = debugLevel;;
+
+    // Log messages can go to a file from a background thread instead
+    if (!logFile.empty() && !startAsyncLog(logFile)) {
+        std::cout << "Could not open log file " << logFile << "." << std::endl;
+        return -1;
+    }
+
+    // -c and -r are required flags, unless a compiled or shared FIB is given
+    if (!fibFile.empty() || !shmName.empty()) {
+        DEBUG << "Proper flags received." << ENDL;
+    } else if (configFile == "") {
+        std::cout << "Missing configuration file! For more info, use the -h flag." << std::endl;
+    } else if (routeFile == "") {
+        std::cout << "Missing route table file! For more info, use the -h flag." << std::endl;
+    } else {
+        DEBUG << "Proper flags received." << ENDL;
+    }
+
+    // Counting per route needs the engine to report which prefix matched,
+    // without --stats none of it is set up
+    std::unique_ptr<Stats> stats;
+    if (!statsFile.empty()) {
+        stats.reset(new Stats());
+        struct sigaction sa = {};
+        sa.sa_handler = requestStats;
+        // Reads in progress carry on rather than ending the input early
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &sa, nullptr);
+    }
+
+    // The tables built from here on get huge pages where the system has them
+    setHugePages(hugePages);
+
+    std::unique_ptr<Fib> built(new Fib());
+    Fib &fib = *built;
+    fib.setRouteTracking(stats != nullptr);
+    auto phase = Clock::now();
+    SharedFib shared;
+    uint64_t generation = 0;  // of the shared FIB in use
+    uint64_t rejected = 0;    // newest generation that did not load, not tried again
+    auto newerGeneration = [&] {
+        uint64_t published = shared.generation();
+        return published != generation && published != rejected;
+    };
+    auto keepGeneration = [&](uint64_t tried) {
+        rejected = tried;
+        WARNING << "Keeping generation " << generation << " of " << shared.name() << ", generation " << tried
+                << " does not load." << ENDL;
+    };
+    if (!shmName.empty()) {
+        // Another process built the FIB, its tables are used where they are
+        std::shared_ptr<MappedFile> map;
+        if (!shared.open(shmName) || !(map = shared.attach(generation)) ||
+            !fib.attachImage(map->data(), map->size(), lpmName, map)) {
+            return -1;
+        }
+        DEBUG << "Attached generation " << generation << " of " << shared.name() << "." << ENDL;
+        if (stats) {
+            stats->addPhase(Stats::LOAD, msSince(phase));
+        }
+    } else if (!fibFile.empty()) {
+        // A snapshot is mapped as is, there is nothing to parse
+        if (!fib.load(fibFile, lpmName)) {
+            return -1;
+        }
+        if (stats) {
+            stats->addPhase(Stats::LOAD, msSince(phase));
+        }
+    } else {
+        // Load config files
+        std::vector<InterfaceEntry> interfaces;
+        std::vector<RouteEntry> routes;
+        if (!parseInterfaces(configFile, interfaces) || !parseRoutes(routeFile, routes, loadThreads)) {
+            return -1;
+        }
+        if (stats) {
+            stats->addPhase(Stats::PARSE, msSince(phase));
+            phase = Clock::now();
+        }
+
+        // Build the longest prefix match engine once, every packet queries it
+        auto lpm = makeEngine(lpmName, interfaces.size() + routes.size());
+        if (!lpm) {
+            std::cout << "Unknown lookup engine " << lpmName << ", use auto, linear, simd, trie, dir24 or poptrie[:<directBits>]." << std::endl;
+            return -1;
+        }
+        if (!fib.build(std::move(interfaces), routes, std::move(lpm), loadThreads)) {
+            return -1;
+        }
+        if (stats) {
+            stats->addPhase(Stats::BUILD, msSince(phase));
+        }
+    }
+    phase = Clock::now();
+    if (!updateFile.empty() && !applyRouteUpdates(updateFile, fib)) {
+        return -1;
+    }
+    if (stats) {
+        stats->addPhase(Stats::UPDATES, msSince(phase));
+    }
+    DEBUG << "Built " << fib.lpm().name() << " engine using " << fib.lpm().memoryUsage() << " bytes." << ENDL;
+    if (hugePages) {
+        HugePageReport pages = hugePageReport();
+        DEBUG << "Huge pages: " << pages.hugetlbBytes << " bytes explicit, " << pages.advisedBytes
+              << " bytes advised for transparent ones." << ENDL;
+    }
+
+    // --compile only writes the snapshot for a later -f
+    if (compile) {
+        if (outputFile.empty()) {
+            std::cout << "--compile needs -o <fibSnapshot>." << std::endl;
+            return -1;
+        }
+        if (!fib.save(outputFile)) {
+            return -1;
+        }
+        std::cout << "FIB with " << fib.prefixTable().size() << " prefixes written to " << outputFile << "." << std::endl;
+        return 0;
+    }
+
+    // --shm-publish hands the FIB to --shm readers, which switch over on
+    // their next lookup
+    if (!shmPublish.empty()) {
+        if (!SharedFib::publish(shmPublish, fib, generation)) {
+            return -1;
+        }
+        std::cout << "FIB with " << fib.prefixTable().size() << " prefixes published as generation " << generation
+                  << " of " << shmPublish << "." << std::endl;
+        return 0;
+    }
+
+    // --serve answers lookups from other programs until it is stopped
+    if (!serveAddr.empty()) {
+        LookupServer server(fib, stats ? stats->registerThread(fib) : nullptr);
+        if (!server.listen(serveAddr)) {
+            return -1;
+        }
+        struct sigaction sa = {};
+        sa.sa_handler = requestStop;
+        sigaction(SIGINT, &sa, nullptr);
+        sigaction(SIGTERM, &sa, nullptr);
+        std::cout << "Serving lookups on " << serveAddr << "." << std::endl;
+
+        phase = Clock::now();
+        bool ok = server.run([&] {
+            // Nothing else uses the FIB on this thread, so a newer shared
+            // one can be attached right here
+            if (!shmName.empty() && newerGeneration()) {
+                // A FIB that fails to attach is left as it was
+                uint64_t tried = shared.generation();
+                std::shared_ptr<MappedFile> map = shared.attach(tried);
+                if (map && fib.attachImage(map->data(), map->size(), lpmName, map)) {
+                    generation = tried;
+                    DEBUG << "Now serving generation " << generation << " of " << shared.name() << "." << ENDL;
+                } else {
+                    keepGeneration(tried);
+                }
+            }
+            if (stats && statsRequested) {
+                statsRequested = 0;
+                stats->write(statsFile, fib);
+            }
+            return !stopServing;
+        });
+        if (stats) {
+            stats->addPhase(Stats::FORWARD, msSince(phase));
+            stats->addPhase(Stats::TOTAL, msSince(started));
+            ok = stats->write(statsFile, fib) && ok;
+        }
+        return ok ? 0 : -1;
+    }
+
+
+    // Binary results on stdout must not be mixed with these messages
+    std::ostream &notes = binaryOut && outputFile.empty() ? std::cerr : std::cout;
+
+    // Set up input to be stdin unless the -i flag was specified
+    std::istream *in = &std::cin;
+    std::ifstream fileIn;
+    MappedFile mapIn;
+    bool mapped = !inputFile.empty() && useMmap;
+    if (mapped) {
+        if (!mapIn.open(inputFile)) {
+            DEBUG << "Error: could not map input file." << ENDL;
+            return -1;
+        }
+        DEBUG << "Now mapping input file." << ENDL;
+    } else if (!inputFile.empty()) {
+        fileIn.open(inputFile, binaryIn ? std::ios::binary : std::ios::in);
+        if (!fileIn) {
+            DEBUG << "Error: could not open input file." << ENDL;
+            return -1;
+        }
+        in = &fileIn;
+        DEBUG << "Now opening input file." << ENDL;
+    } else {
+        notes << "No input file specified. Ready to use stdin." << std::endl;
+    }
+
+    // Set up output to be stdout unless the -o flag was specified
+    int outFd = STDOUT_FILENO;
+    if (!outputFile.empty()) {
+        outFd = open(outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outFd < 0) {
+            DEBUG << "Error: could not open output file." << ENDL;
+            return -1;
+        }
+        DEBUG << "Now opening output file." << ENDL;
+    } else {
+        notes << "No output file specified. Program will use stdout.\n" << std::endl;
+    }
+
+    // Results are written in large batches. Someone typing addresses on a
+    // terminal wants each answer right away, so that defaults to per line.
+    OutputWriter out(outFd);
+    out.setBinary(binaryOut);
+    if (flushEvery < 0) {
+        flushEvery = (inputFile.empty() && isatty(STDIN_FILENO)) ? 1 : 0;
+    }
+    out.setFlushEvery((size_t) flushEvery);
+
+    // Route updates in the input go to a second copy of the FIB, which is
+    // published before the next destination. Lookups never wait for them.
+    Rcu<Fib> fibs(std::move(built));
+    const Fib *live = &fibs.current();
+
+    // With -j the lookups are spread over worker threads, otherwise they run inline
+    std::unique_ptr<ParallelForwarder> pool;
+    if (threads > 1) {
+        pool.reset(new ParallelForwarder(fibs, out, threads, cacheEntries, stats.get()));
+        pool->setFlushEvery((size_t) flushEvery);
+        DEBUG << "Forwarding on " << threads << " threads." << ENDL;
+    }
+    // Without -j the main thread keeps the one result cache
+    std::unique_ptr<RouteCache> cache;
+    if (cacheEntries > 0 && !pool) {
+        cache.reset(new RouteCache(cacheEntries));
+    }
+    ThreadStats *counters = stats && !pool ? stats->registerThread(*live) : nullptr;
+    // Inline lookups are batched too, unless every line has to go out at once
+    std::vector<uint32_t> batch;
+    batch.reserve(LpmEngine::BATCH);
+    phase = Clock::now();
+    auto forward = [&](uint32_t dest) {
+        if (stats && statsRequested) {
+            statsRequested = 0;
+            stats->write(statsFile, fibs.current());
+        }
+
+        // A newly published shared FIB goes in like a route update
+        if (!shmName.empty() && newerGeneration()) {
+            // Checked on a scratch FIB first, both copies have to take it
+            uint64_t tried;
+            if (auto map = shared.attachChecked(tried, lpmName, stats != nullptr)) {
+                std::string name = shared.name();
+                fibs.modify([map, lpmName, tried, name](Fib &f) {
+                    if (!f.attachImage(map->data(), map->size(), lpmName, map)) {
+                        ERROR << "Could not switch to generation " << tried << " of " << name << "." << ENDL;
+                    }
+                });
+                generation = tried;
+                DEBUG << "Switching to generation " << generation << " of " << shared.name() << "." << ENDL;
+            } else {
+                keepGeneration(tried);
+            }
+        }
+
+        // Everything read before the updates still uses the old version
+        if (fibs.pending()) {
+            if (pool) {
+                pool->flush();
+            } else {
+                processBatch(batch.data(), batch.size(), *live, out, cache.get(), counters);
+                batch.clear();
+            }
+            fibs.publish();
+            live = &fibs.current();
+        }
+
+        if (pool) {
+            pool->add(dest);
+        } else if (flushEvery == 1) {
+            processPacket(dest, *live, out, cache.get(), counters);
+        } else {
+            batch.push_back(dest);
+            if (batch.size() == LpmEngine::BATCH) {
+                processBatch(batch.data(), batch.size(), *live, out, cache.get(), counters);
+                batch.clear();
+            }
+        }
+    };
+    auto update = [&](const char *p, const char *end) {
+        bool withdraw;
+        RouteEntry r;
+        if (readRouteUpdate(p, end, withdraw, r)) {
+            fibs.modify([withdraw, r](Fib &f) { applyRouteUpdate(withdraw, r, f); });
+        }
+    };
+
+    if (binaryIn) {
+        // Raw little endian destinations, there are no comments or updates.
+        // Mapped input is read in place, anything else in large blocks.
+        char block[1 << 16];
+        const char *p = mapped ? mapIn.data() : block;
+        size_t have = mapped ? mapIn.size() : 0;
+        while (true) {
+            size_t whole = have & ~(size_t) 3;
+            for (size_t off = 0; off < whole; off += 4) {
+                uint32_t dest;
+                memcpy(&dest, p + off, sizeof(dest));
+                forward(littleEndian(dest));
+            }
+            memmove(block, p + whole, have - whole);
+            p = block;
+            have -= whole;
+            if (mapped || (!in->read(block + have, sizeof(block) - have) && in->gcount() == 0)) {
+                break;
+            }
+            have += (size_t) in->gcount();
+        }
+        if (have > 0) {
+            WARNING << "Binary input ends in " << have << " stray bytes, ignoring them." << ENDL;
+        }
+    } else if (mapped) {
+        // Scan addresses in place over the mapped bytes
+        const char *p = mapIn.data(), *end = p + mapIn.size();
+        const char *line, *lineEnd;
+        while (nextLine(p, end, line, lineEnd)) {
+            if (line == lineEnd || isComment(line, lineEnd)) {
+                continue;
+            }
+            if (isRouteUpdate(line, lineEnd)) {
+                update(line, lineEnd);
+                continue;
+            }
+
+            // The parser stops at the newline, so it may look ahead into the mapping
+            uint32_t dest;
+            if (!readDestination(line, lineEnd, end, dest)) {
+                continue;
+            }
+
+            forward(dest);
+        }
+    } else {
+        // Process packets per line from the input
+        std::string line;
+        while (std::getline(*in, line)) {
+            // If line has no data, continue
+            if (line.empty() || isComment(line.data(), line.data() + line.size())) {
+                continue;
+            }
+            if (isRouteUpdate(line.data(), line.data() + line.size())) {
+                update(line.data(), line.data() + line.size());
+                continue;
+            }
+
+            uint32_t dest;
+            if (!readDestination(line.data(), line.data() + line.size(), line.data() + line.size(), dest)) {
+                continue;
+            }
+
+            forward(dest);
+        }
+    }
+
+    if (pool) {
+        pool->finish();
+    }
+    processBatch(batch.data(), batch.size(), *live, out, cache.get(), counters);
+    out.flush();
+    if (stats) {
+        stats->addPhase(Stats::FORWARD, msSince(phase));
+        stats->addPhase(Stats::TOTAL, msSince(started));
+        if (!stats->write(statsFile, fibs.current())) {
+            return -1;
+        }
+    }
+    if (!logFile.empty()) {
+        uint64_t dropped = asyncLogDropped();
+        stopAsyncLog();
+        if (dropped) {
+            std::cerr << "WARNING: " << dropped << " log messages were dropped." << std::endl;
+        }
+    }
+    if (cacheEntries > 0) {
+        uint64_t hits = pool ? pool->cacheHits() : cache->hits();
+        uint64_t misses = pool ? pool->cacheMisses() : cache->misses();
+        notes << "Route cache: " << hits << " hits, " << misses << " misses." << std::endl;
+    }
+    notes << "\nPackets done processing! Program will now exit." << std::endl;
+    fileIn.close();
+    if (outFd != STDOUT_FILENO) {
+        close(outFd);
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hugepages.h"
+#include "mmapfile.h"
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string &path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    return fd >= 0 && mapWhole(fd, true);
+}
+
+bool MappedFile::openShared(const std::string &name) {
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    return fd >= 0 && mapWhole(fd, false);
+}
+
+bool MappedFile::mapWhole(int fd, bool sequential) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+
+    // An empty file is valid input, there is just nothing to map
+    length = (size_t) st.st_size;
+    if (length > 0) {
+        void *p = mmap(nullptr, length, PROT_READ, sequential ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            length = 0;
+            ::close(fd);
+            return false;
+        }
+        if (sequential) {
+            madvise(p, length, MADV_SEQUENTIAL);
+        } else {
+            adviseHugePages(p, length);
+        }
+        addr = static_cast<const char *>(p);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close() {
+    if (addr) {
+        munmap(const_cast<char *>(addr), length);
+    }
+    addr = nullptr;
+    length = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef MMAPFILE_H
+#define MMAPFILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file, unmapped when destroyed
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Map path for sequential reading, false if it cannot be opened or mapped
+    bool open(const std::string &path);
+
+    // Map the POSIX shared memory object name, as given to shm_open()
+    bool openShared(const std::string &name);
+    void close();
+
+    const char *data() const { return addr; }
+    size_t size() const { return length; }
+
+private:
+    // Map all of fd, which is closed either way
+    bool mapWhole(int fd, bool sequential);
+
+    const char *addr = nullptr;
+    size_t length = 0;
+};
+
+#endif
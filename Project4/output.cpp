@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#include "output.h"
+#include "ipconv.h"
+#include "logging.h"
+
+OutputWriter::OutputWriter(int fd, size_t capacity) : fd(fd), buf(capacity < 256 ? 256 : capacity) {}
+
+OutputWriter::~OutputWriter() {
+    flush();
+}
+
+bool OutputWriter::makeRoom(size_t n) {
+    if (buf.size() - used >= n) {
+        return true;
+    }
+    if (fd == MEMORY_ONLY) {
+        buf.resize(std::max(buf.size() * 2, used + n));
+        return true;
+    }
+    flush();
+    return buf.size() >= n;
+}
+
+// Writes all of [p, p + n) directly to the descriptor
+bool OutputWriter::writeAll(const char *p, size_t n) {
+    while (n > 0 && !error) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w < 0) {
+            ERROR << "Write to output failed: " << strerror(errno) << ENDL;
+            error = true;
+            break;
+        }
+        p += w;
+        n -= (size_t) w;
+    }
+    return !error;
+}
+
+void OutputWriter::put(const char *s, size_t n) {
+    // Anything larger than the whole buffer goes straight through
+    if (!makeRoom(n)) {
+        writeAll(s, n);
+        return;
+    }
+    memcpy(buf.data() + used, s, n);
+    used += n;
+}
+
+void OutputWriter::putIP(uint32_t ip) {
+    makeRoom(IPV4_BUF);
+    used += formatIPv4(ip, buf.data() + used);
+}
+
+void OutputWriter::putRecord(const BinaryRecord &r) {
+    BinaryRecord le = {littleEndian(r.dest), (int32_t) littleEndian((uint32_t) r.iface), littleEndian(r.nextHop),
+                       (int32_t) littleEndian((uint32_t) r.status)};
+    makeRoom(sizeof(le));
+    memcpy(buf.data() + used, &le, sizeof(le));
+    used += sizeof(le);
+    if (flushEvery && ++pendingLines >= flushEvery) {
+        flush();
+    }
+}
+
+void OutputWriter::endLine() {
+    makeRoom(1);
+    buf[used++] = '\n';
+    if (flushEvery && ++pendingLines >= flushEvery) {
+        flush();
+    }
+}
+
+bool OutputWriter::flush() {
+    if (fd == MEMORY_ONLY) {
+        return true;
+    }
+    writeAll(buf.data(), used);
+    used = 0;
+    pendingLines = 0;
+    return !error;
+}
@@ -0,0 +1,70 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One result in the binary output format, every field little endian
+struct BinaryRecord {
+    uint32_t dest;
+    int32_t iface;      // interface index, UNRESOLVED when there is none
+    uint32_t nextHop;
+    int32_t status;     // a ForwardStatus
+};
+
+// Collects forwarding results in one reusable buffer and hands it to the
+// kernel with a single write() per batch instead of flushing every line.
+// A writer made with fd MEMORY_ONLY never writes, its buffer grows instead.
+class OutputWriter {
+public:
+    static constexpr int MEMORY_ONLY = -1;
+
+    explicit OutputWriter(int fd, size_t capacity = 1 << 20);
+    ~OutputWriter();
+    OutputWriter(const OutputWriter &) = delete;
+    OutputWriter &operator=(const OutputWriter &) = delete;
+
+    // Flush after every n lines, 1 behaves like std::endl and 0 only flushes
+    // when the buffer is full
+    void setFlushEvery(size_t n) { flushEvery = n; }
+
+    void put(const char *s, size_t n);
+    void put(const std::string &s) { put(s.data(), s.size()); }
+    void putIP(uint32_t ip);
+
+    // Results go out as BinaryRecords instead of text lines
+    void setBinary(bool on) { binary = on; }
+    bool isBinary() const { return binary; }
+
+    // Appends one record, counted like a line for setFlushEvery()
+    void putRecord(const BinaryRecord &r);
+
+    // Terminates the current line and flushes if the line count says so
+    void endLine();
+
+    // Writes out everything buffered, false once a write has failed
+    bool flush();
+
+    bool failed() const { return error; }
+
+    // Buffered bytes, mostly useful for MEMORY_ONLY writers
+    const char *data() const { return buf.data(); }
+    size_t size() const { return used; }
+    void clear() { used = 0; pendingLines = 0; }
+
+private:
+    bool makeRoom(size_t n);
+    bool writeAll(const char *p, size_t n);
+
+    int fd;
+    std::vector<char> buf;
+    size_t used = 0;
+    size_t flushEvery = 0;
+    size_t pendingLines = 0;
+    bool error = false;
+    bool binary = false;
+};
+
+#endif
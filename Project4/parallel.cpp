@@ -0,0 +1,103 @@
+#include "parallel.h"
+#include "router.h"
+#include "fib.h"
+#include "output.h"
+#include "routecache.h"
+#include "stats.h"
+
+ParallelForwarder::ParallelForwarder(Rcu<Fib> &fibs, OutputWriter &out, int threads, size_t cacheEntries, Stats *stats,
+                                     size_t chunkSize)
+    : fibs(fibs), out(out), cacheEntries(cacheEntries), chunkSize(chunkSize), maxQueued(2 * (size_t) threads) {
+    current.reserve(chunkSize);
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&ParallelForwarder::worker, this, stats ? stats->registerThread(fibs.current()) : nullptr);
+    }
+}
+
+ParallelForwarder::~ParallelForwarder() {
+    finish();
+}
+
+void ParallelForwarder::add(uint32_t dest) {
+    current.push_back(dest);
+    if (current.size() >= chunkSize || (flushEvery && current.size() >= flushEvery)) {
+        submit();
+    }
+}
+
+void ParallelForwarder::submit() {
+    std::unique_lock<std::mutex> guard(lock);
+    space.wait(guard, [this] { return queue.size() < maxQueued; });
+    queue.push_back(Chunk{nextSeq++, std::move(current), fibs.acquire()});
+    guard.unlock();
+    ready.notify_one();
+
+    current = std::vector<uint32_t>();
+    current.reserve(chunkSize);
+}
+
+void ParallelForwarder::flush() {
+    if (!current.empty()) {
+        submit();
+    }
+}
+
+void ParallelForwarder::finish() {
+    if (workers.empty()) {
+        return;
+    }
+    if (!current.empty()) {
+        submit();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closing = true;
+    }
+    ready.notify_all();
+    for (auto &t : workers) {
+        t.join();
+    }
+    workers.clear();
+}
+
+void ParallelForwarder::worker(ThreadStats *stats) {
+    OutputWriter local(OutputWriter::MEMORY_ONLY, 64 * chunkSize);
+    local.setBinary(out.isBinary());
+    std::unique_ptr<RouteCache> cache;
+    if (cacheEntries > 0) {
+        cache.reset(new RouteCache(cacheEntries));
+    }
+
+    while (true) {
+        Chunk chunk;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ready.wait(guard, [this] { return !queue.empty() || closing; });
+            if (queue.empty()) {
+                if (cache) {
+                    hits += cache->hits();
+                    misses += cache->misses();
+                }
+                return;
+            }
+            chunk = std::move(queue.front());
+            queue.pop_front();
+        }
+        space.notify_one();
+
+        local.clear();
+        processBatch(chunk.dests.data(), chunk.dests.size(), *chunk.fib, local, cache.get(), stats);
+        fibs.release(chunk.fib);
+
+        // Chunks are written strictly in sequence order
+        std::unique_lock<std::mutex> guard(lock);
+        turn.wait(guard, [&] { return nextWrite == chunk.seq; });
+        out.put(local.data(), local.size());
+        if (flushEvery) {
+            out.flush();
+        }
+        nextWrite++;
+        guard.unlock();
+        turn.notify_all();
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <vector>
+#include "rcu.h"
+
+class Fib;
+class OutputWriter;
+class Stats;
+struct ThreadStats;
+
+// Resolves destinations on a pool of worker threads against a shared FIB.
+// Input is cut into numbered chunks; each worker formats its chunk privately
+// and then waits for its turn, so results are written in the original input
+// order. Every chunk holds the FIB version that was published when it was
+// queued, so route updates never wait for, or stop, the workers.
+class ParallelForwarder {
+public:
+    // Each worker gets a private result cache of cacheEntries, 0 for none,
+    // and its own counters in stats when that is given
+    ParallelForwarder(Rcu<Fib> &fibs, OutputWriter &out, int threads, size_t cacheEntries = 0, Stats *stats = nullptr,
+                      size_t chunkSize = 16384);
+    ~ParallelForwarder();
+    ParallelForwarder(const ParallelForwarder &) = delete;
+    ParallelForwarder &operator=(const ParallelForwarder &) = delete;
+
+    // Hand a chunk to the workers every n destinations and write its results
+    // out as soon as it is done, like OutputWriter::setFlushEvery(). Call
+    // before the first add(); 0 fills whole chunks.
+    void setFlushEvery(size_t n) { flushEvery = n; }
+
+    // Queue one destination, blocks while too many chunks are waiting
+    void add(uint32_t dest);
+
+    // Queue what was added so far as its own chunk, so that destinations
+    // added after a FIB update are resolved against the new version
+    void flush();
+
+    // Process everything queued so far and stop the workers
+    void finish();
+
+    // Result cache counters of all workers, complete once finish() returned
+    uint64_t cacheHits() const { return hits; }
+    uint64_t cacheMisses() const { return misses; }
+
+private:
+    struct Chunk {
+        size_t seq;
+        std::vector<uint32_t> dests;
+        const Fib *fib;
+    };
+
+    void submit();
+    void worker(ThreadStats *stats);
+
+    Rcu<Fib> &fibs;
+    OutputWriter &out;
+    size_t cacheEntries;
+    size_t chunkSize;
+    size_t maxQueued;
+    size_t flushEvery = 0;
+
+    std::vector<uint32_t> current;
+    size_t nextSeq = 0;
+
+    std::mutex lock;
+    std::condition_variable ready;   // a chunk was queued or we are closing
+    std::condition_variable space;   // a chunk was taken off the queue
+    std::condition_variable turn;    // a chunk finished writing
+    std::deque<Chunk> queue;
+    size_t nextWrite = 0;
+    bool closing = false;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    std::vector<std::thread> workers;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+// Hand written tokenizer for the interface, route and input files. Every
+// function works on a [p, end) range of an in-memory buffer and moves p past
+// whatever it consumed, so no strings or regex matches are created per line.
+
+// Same characters as \s in the old regexes, minus the line terminator
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline void skipBlanks(const char *&p, const char *end) {
+    while (p < end && isBlank(*p)) {
+        p++;
+    }
+}
+
+// Splits off the next line (without its '\n'), false once the buffer is used up
+inline bool nextLine(const char *&p, const char *end, const char *&lineStart, const char *&lineEnd) {
+    if (p >= end) {
+        return false;
+    }
+    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+    lineStart = p;
+    lineEnd = nl ? nl : end;
+    p = nl ? nl + 1 : end;
+    return true;
+}
+
+// Lines whose first non-blank character is '#'
+inline bool isComment(const char *p, const char *end) {
+    skipBlanks(p, end);
+    return p < end && *p == '#';
+}
+
+// Lines whose first non-blank character is '+' or '-', route updates
+inline bool isRouteUpdate(const char *p, const char *end) {
+    skipBlanks(p, end);
+    return p < end && (*p == '+' || *p == '-');
+}
+
+// Unsigned decimal of at most maxDigits digits that is no larger than maxValue
+inline bool parseNumber(const char *&p, const char *end, uint32_t maxValue, int maxDigits, uint32_t &value) {
+    const char *stop = (end - p > maxDigits) ? p + maxDigits : end;
+    auto res = std::from_chars(p, stop, value);
+    if (res.ec != std::errc() || value > maxValue || (res.ptr < end && *res.ptr >= '0' && *res.ptr <= '9')) {
+        return false;
+    }
+    p = res.ptr;
+    return true;
+}
+
+// Dotted quad such as 138.67.1.1
+inline bool parseIPv4(const char *&p, const char *end, uint32_t &ip) {
+    const char *q = p;
+    uint32_t result = 0;
+    for (int i = 0; i < 4; i++) {
+        if (i > 0) {
+            if (q >= end || *q != '.') {
+                return false;
+            }
+            q++;
+        }
+        uint32_t octet;
+        if (!parseNumber(q, end, 255, 3, octet)) {
+            return false;
+        }
+        result = (result << 8) | octet;
+    }
+    ip = result;
+    p = q;
+    return true;
+}
+
+// Prefix length after the '/' of a CIDR block, 0 to 32
+inline bool parseMaskLen(const char *&p, const char *end, int &maskLen) {
+    if (p >= end || *p != '/') {
+        return false;
+    }
+    const char *q = p + 1;
+    uint32_t len;
+    if (!parseNumber(q, end, 32, 2, len)) {
+        return false;
+    }
+    maskLen = (int) len;
+    p = q;
+    return true;
+}
+
+#endif
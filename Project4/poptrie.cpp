@@ -0,0 +1,238 @@
+#include <algorithm>
+#include "poptrie.h"
+
+static const size_t LANES = 8;
+
+PopTrie::PopTrie(int directBits) : directBits(std::max(0, std::min(directBits, MAX_DIRECT_BITS))) {
+    engineName = this->directBits == 16 ? "poptrie" : "poptrie:" + std::to_string(this->directBits);
+}
+
+// Shorter prefixes first, so longer ones paint over them. Of two equal
+// prefixes the one listed first is painted last and wins, as in findRoute().
+static void paintOrder(std::vector<uint32_t> &ids, const PrefixTable &prefixes) {
+    std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) {
+        return prefixes.maskLen[a] != prefixes.maskLen[b] ? prefixes.maskLen[a] < prefixes.maskLen[b] : a > b;
+    });
+}
+
+bool PopTrie::build(const PrefixTable &prefixes) {
+    size_t slots = (size_t) 1 << directBits;
+    std::vector<int32_t> best(slots, NO_ROUTE);
+    nodes.clear();
+    leaves.clear();
+
+    std::vector<uint32_t> ids(prefixes.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        ids[i] = (uint32_t) i;
+    }
+    paintOrder(ids, prefixes);
+
+    // Short prefixes go straight into the direct table, the others are
+    // grouped by direct slot to become the subtrees below it
+    std::vector<uint32_t> start(slots + 1, 0);
+    for (uint32_t id : ids) {
+        int len = prefixes.maskLen[id];
+        uint32_t slot = directIndex(prefixes.network[id]);
+        if (len <= directBits) {
+            std::fill(best.begin() + slot, best.begin() + slot + ((size_t) 1 << (directBits - len)), prefixes.hop[id]);
+        } else {
+            start[slot + 1]++;
+        }
+    }
+    for (size_t s = 0; s < slots; s++) {
+        start[s + 1] += start[s];
+    }
+    std::vector<uint32_t> deeper(start[slots]);
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for (uint32_t id : ids) {
+        if (prefixes.maskLen[id] > directBits) {
+            deeper[fill[directIndex(prefixes.network[id])]++] = id;
+        }
+    }
+
+    direct.assign(slots, 0);
+    std::vector<uint32_t> group;
+    for (size_t s = 0; s < slots; s++) {
+        if (start[s + 1] == start[s]) {
+            direct[s] = LEAF | (uint32_t) (best[s] + 1);
+            continue;
+        }
+        uint32_t node = (uint32_t) nodes.size();
+        nodes.push_back(Node{0, 0, 0, 0});
+        direct[s] = node;
+        group.assign(deeper.begin() + start[s], deeper.begin() + start[s + 1]);
+        buildNode(node, directBits, group, best[s], prefixes);
+    }
+
+    directTbl = direct.data();
+    nodeTbl = nodes.data();
+    leafTbl = leaves.data();
+    nodeTotal = nodes.size();
+    leafTotal = leaves.size();
+    return true;
+}
+
+void PopTrie::buildNode(uint32_t index, int offset, std::vector<uint32_t> &ids, int inherited, const PrefixTable &prefixes) {
+    const int SLOTS = 1 << STRIDE;
+    int best[SLOTS];
+    std::fill(best, best + SLOTS, inherited);
+    std::vector<std::vector<uint32_t>> deeper(SLOTS);
+
+    paintOrder(ids, prefixes);
+    for (uint32_t id : ids) {
+        int len = prefixes.maskLen[id];
+        uint32_t slot = slotOf(prefixes.network[id], offset);
+        if (len <= offset + STRIDE) {
+            std::fill(best + slot, best + slot + (1 << (offset + STRIDE - len)), prefixes.hop[id]);
+        } else {
+            deeper[slot].push_back(id);
+        }
+    }
+
+    Node n{0, 0, 0, (uint32_t) leaves.size()};
+    for (int s = 0; s < SLOTS; s++) {
+        if (!deeper[s].empty()) {
+            n.children |= 1ull << s;
+        }
+    }
+    bool first = true;
+    for (int s = 0; s < SLOTS; s++) {
+        if (n.children & (1ull << s)) {
+            continue;
+        }
+        if (first || best[s] != leaves.back()) {
+            n.leafRuns |= 1ull << s;
+            leaves.push_back(best[s]);
+            first = false;
+        }
+    }
+
+    // The children are allocated together before any of them is filled, so
+    // they stay next to each other whatever their own subtrees add
+    n.childBase = (uint32_t) nodes.size();
+    nodes.resize(nodes.size() + __builtin_popcountll(n.children));
+    nodes[index] = n;
+    uint32_t child = n.childBase;
+    for (int s = 0; s < SLOTS; s++) {
+        if (!deeper[s].empty()) {
+            buildNode(child++, offset + STRIDE, deeper[s], best[s], prefixes);
+        }
+    }
+}
+
+int PopTrie::lookup(uint32_t dest) const {
+    uint32_t entry = directTbl[directIndex(dest)];
+    if (entry & LEAF) {
+        return (int) (entry & ~LEAF) - 1;
+    }
+
+    const Node *n = &nodeTbl[entry];
+    for (int offset = directBits;; offset += STRIDE) {
+        uint64_t bit = 1ull << slotOf(dest, offset);
+        if (!(n->children & bit)) {
+            return leafTbl[n->leafBase + __builtin_popcountll(n->leafRuns & ((bit << 1) - 1)) - 1];
+        }
+        n = &nodeTbl[n->childBase + __builtin_popcountll(n->children & (bit - 1))];
+    }
+}
+
+void PopTrie::lookupBatch(const uint32_t *dests, int *hops, size_t n) const {
+    for (size_t base = 0; base < n; base += LANES) {
+        size_t lanes = std::min(LANES, n - base);
+        for (size_t i = 0; i < lanes; i++) {
+            __builtin_prefetch(&directTbl[directIndex(dests[base + i])]);
+        }
+
+        // Lanes still inside the node array move one level per round, while
+        // the next node of each is prefetched
+        const Node *node[LANES];
+        int offset[LANES];
+        size_t active = 0;
+        for (size_t i = 0; i < lanes; i++) {
+            uint32_t entry = directTbl[directIndex(dests[base + i])];
+            if (entry & LEAF) {
+                hops[base + i] = (int) (entry & ~LEAF) - 1;
+                node[i] = nullptr;
+            } else {
+                node[i] = &nodeTbl[entry];
+                offset[i] = directBits;
+                __builtin_prefetch(node[i]);
+                active++;
+            }
+        }
+        while (active > 0) {
+            active = 0;
+            for (size_t i = 0; i < lanes; i++) {
+                const Node *cur = node[i];
+                if (!cur) {
+                    continue;
+                }
+                uint64_t bit = 1ull << slotOf(dests[base + i], offset[i]);
+                if (!(cur->children & bit)) {
+                    hops[base + i] = leafTbl[cur->leafBase + __builtin_popcountll(cur->leafRuns & ((bit << 1) - 1)) - 1];
+                    node[i] = nullptr;
+                    continue;
+                }
+                node[i] = &nodeTbl[cur->childBase + __builtin_popcountll(cur->children & (bit - 1))];
+                offset[i] += STRIDE;
+                __builtin_prefetch(node[i]);
+                active++;
+            }
+        }
+    }
+}
+
+size_t PopTrie::memoryUsage() const {
+    return ((size_t) 1 << directBits) * sizeof(uint32_t) + nodeTotal * sizeof(Node) + leafTotal * sizeof(int32_t);
+}
+
+std::vector<std::pair<const void *, size_t>> PopTrie::exportArrays() const {
+    return {{directTbl, ((size_t) 1 << directBits) * sizeof(uint32_t)},
+            {nodeTbl, nodeTotal * sizeof(Node)},
+            {leafTbl, leafTotal * sizeof(int32_t)}};
+}
+
+bool PopTrie::attachArrays(const std::vector<std::pair<const void *, size_t>> &arrays, size_t values) {
+    if (arrays.size() != 3 || arrays[0].second != ((size_t) 1 << directBits) * sizeof(uint32_t) ||
+        arrays[1].second % sizeof(Node) || arrays[2].second % sizeof(int32_t)) {
+        return false;
+    }
+    const uint32_t *dir = static_cast<const uint32_t *>(arrays[0].first);
+    const Node *nodeArray = static_cast<const Node *>(arrays[1].first);
+    size_t nodeCount = arrays[1].second / sizeof(Node);
+    const int32_t *leafArray = static_cast<const int32_t *>(arrays[2].first);
+    size_t leafCount = arrays[2].second / sizeof(int32_t);
+
+    // Lookups follow these indices and return these values without checks,
+    // so they must all be in range
+    for (size_t s = 0; s < arrays[0].second / sizeof(uint32_t); s++) {
+        if ((dir[s] & LEAF) ? (dir[s] & ~LEAF) > values : dir[s] >= nodeCount) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < leafCount; i++) {
+        if (leafArray[i] != NO_ROUTE && (leafArray[i] < 0 || (size_t) leafArray[i] >= values)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < nodeCount; i++) {
+        const Node &n = nodeArray[i];
+        uint64_t leafSlots = ~n.children;
+        // Children come after their parent, so a lookup cannot go round in circles
+        if ((n.children && n.childBase <= i) || n.childBase + (size_t) __builtin_popcountll(n.children) > nodeCount ||
+            n.leafBase + (size_t) __builtin_popcountll(n.leafRuns) > leafCount || (n.leafRuns & n.children) ||
+            (leafSlots && !(n.leafRuns & leafSlots & (0 - leafSlots)))) {
+            return false;
+        }
+    }
+
+    direct.clear();
+    nodes.clear();
+    leaves.clear();
+    directTbl = dir;
+    nodeTbl = nodeArray;
+    leafTbl = leafArray;
+    nodeTotal = nodeCount;
+    leafTotal = leafCount;
+    return true;
+}
@@ -0,0 +1,84 @@
+#ifndef POPTRIE_H
+#define POPTRIE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "hugepages.h"
+#include "lpm.h"
+
+// Multibit trie in the style of Poptrie (Asai and Ohara, SIGCOMM 2015). The
+// first directBits of an address index a flat table; below it every node
+// consumes 6 more bits, so a lookup reads at most ceil((32 - directBits) / 6)
+// nodes, three with the default 16 and six with none, instead of up to 32 in
+// the binary trie.
+//
+// A node describes its 64 slots with two bitmaps instead of 64 pointers.
+// Bit i of children is set when slot i continues in a child node, and the
+// children sit next to each other in the node array, so the child for slot
+// i is at childBase + popcount(children below i). Slots that end in a next
+// hop share one leaf per run of equal values: bit i of leafRuns marks where
+// a run starts, and the leaf is at leafBase + popcount(leafRuns up to i) - 1.
+// A full table then takes a few MB.
+//
+// Updates rebuild the whole structure, about half a second at a million
+// prefixes, since the children of a node have to stay next to each other.
+// Tables that change often are better off on the trie or dir24. A snapshot
+// or shared FIB is looked up in place.
+class PopTrie : public LpmEngine {
+public:
+    static constexpr int STRIDE = 6;
+    static constexpr int MAX_DIRECT_BITS = 22;
+
+    // directBits between 0 and MAX_DIRECT_BITS
+    explicit PopTrie(int directBits = 16);
+
+    // "poptrie", or "poptrie:<directBits>" when that is not 16
+    const char *name() const override { return engineName.c_str(); }
+    bool build(const PrefixTable &prefixes) override;
+    int lookup(uint32_t dest) const override;
+    void lookupBatch(const uint32_t *dests, int *hops, size_t n) const override;
+    size_t memoryUsage() const override;
+    std::vector<std::pair<const void *, size_t>> exportArrays() const override;
+    bool attachArrays(const std::vector<std::pair<const void *, size_t>> &arrays, size_t values) override;
+
+    size_t nodeCount() const { return nodeTotal; }
+
+private:
+    struct Node {
+        uint64_t children;
+        uint64_t leafRuns;
+        uint32_t childBase;
+        uint32_t leafBase;
+    };
+
+    // A direct table entry with LEAF set holds next hop + 1, otherwise a node
+    static constexpr uint32_t LEAF = 0x80000000u;
+
+    // The STRIDE bits of dest starting at bit offset, zero past the last bit
+    static uint32_t slotOf(uint32_t dest, int offset) {
+        return (uint32_t) ((((uint64_t) dest << 32) >> (64 - STRIDE - offset)) & ((1u << STRIDE) - 1));
+    }
+
+    uint32_t directIndex(uint32_t dest) const { return directBits ? dest >> (32 - directBits) : 0; }
+
+    // Fill node at index for the prefixes ids, all longer than offset bits
+    // and inside the node's range, where inherited is the best shorter match
+    void buildNode(uint32_t index, int offset, std::vector<uint32_t> &ids, int inherited, const PrefixTable &prefixes);
+
+    int directBits;
+    std::string engineName;
+
+    // Storage for a structure built here; lookups go through the pointers,
+    // which may point into a mapped snapshot instead
+    HugeVector<uint32_t> direct;
+    HugeVector<Node> nodes;
+    HugeVector<int32_t> leaves;
+    const uint32_t *directTbl = nullptr;
+    const Node *nodeTbl = nullptr;
+    const int32_t *leafTbl = nullptr;
+    size_t nodeTotal = 0;
+    size_t leafTotal = 0;
+};
+
+#endif
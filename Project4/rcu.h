@@ -0,0 +1,118 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Read-copy-update for one read-mostly object, such as the FIB, with a
+// single writer. Readers take the published copy with acquire() and give it
+// back with release(); neither ever waits or takes a lock. The writer keeps
+// a second copy, changes that one, and publishes it with an atomic swap of
+// the current index. A copy is only changed again once every reader that
+// acquired it has released it, so nothing is freed under a reader.
+//
+// Each change is recorded and replayed on the other copy before it is next
+// changed, which keeps both in step at the cost of doing every change twice.
+// T must provide std::unique_ptr<T> clone() const.
+//
+// This is a left-right scheme rather than RCU with deferred reclamation,
+// on purpose. Classic RCU would copy the FIB on every update and free the
+// old copy after a grace period. For a large table that copy means
+// rebuilding the lookup engine, which can take hundreds of milliseconds,
+// while a route update in place takes microseconds. Two long-lived copies
+// avoid that. The price is on the writer's side only:
+// - Readers never wait, but the writer can. The first modify() after a
+//   publish() waits for readers still holding the spare copy, for as
+//   long as their longest lookup batch takes.
+// - Every change is applied twice, once to each copy.
+// - Two copies of T are held once the first change is made.
+template <typename T>
+class Rcu {
+public:
+    explicit Rcu(std::unique_ptr<T> initial) { copies[0] = std::move(initial); }
+    Rcu(const Rcu &) = delete;
+    Rcu &operator=(const Rcu &) = delete;
+
+    // Copy readers should use now. Stays valid until handed to release().
+    const T *acquire() {
+        while (true) {
+            int idx = active.load(std::memory_order_seq_cst);
+            readers[idx].count.fetch_add(1, std::memory_order_seq_cst);
+            // The writer may have moved on between the load and the
+            // increment, and could already be changing this copy
+            if (active.load(std::memory_order_seq_cst) == idx) {
+                return copies[idx].get();
+            }
+            readers[idx].count.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void release(const T *copy) {
+        readers[copy == copies[0].get() ? 0 : 1].count.fetch_sub(1, std::memory_order_release);
+    }
+
+    // The published copy, for the writer thread only
+    const T &current() const { return *copies[active.load(std::memory_order_relaxed)]; }
+
+    // Apply f to the unpublished copy, waiting first for the last readers of
+    // that copy to leave. Readers see the change after publish().
+    void modify(std::function<void(T &)> f) {
+        T &next = prepare();
+        f(next);
+        log.push_back(std::move(f));
+        changed = true;
+    }
+
+    // True if there are changes that publish() has not made visible yet
+    bool pending() const { return changed; }
+
+    // Make every change since the last publish() visible to new readers
+    void publish() {
+        if (!changed) {
+            return;
+        }
+        active.store(1 - active.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+        changed = false;
+        // The copy that just went out of use still misses these changes
+        replay.swap(log);
+        log.clear();
+    }
+
+private:
+    struct alignas(64) Readers {
+        std::atomic<size_t> count{0};
+    };
+
+    // The copy that is not published, up to date and free of readers
+    T &prepare() {
+        int spare = 1 - active.load(std::memory_order_relaxed);
+        if (!copies[spare]) {
+            copies[spare] = copies[1 - spare]->clone();
+            replay.clear();
+        }
+        if (!changed) {
+            while (readers[spare].count.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+            for (auto &f : replay) {
+                f(*copies[spare]);
+            }
+            replay.clear();
+        }
+        return *copies[spare];
+    }
+
+    std::unique_ptr<T> copies[2];
+    std::atomic<int> active{0};
+    Readers readers[2];
+
+    // Writer side only
+    std::vector<std::function<void(T &)>> log;     // changes in the unpublished copy
+    std::vector<std::function<void(T &)>> replay;  // changes the unpublished copy still misses
+    bool changed = false;
+};
+
+#endif
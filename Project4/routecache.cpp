@@ -0,0 +1,20 @@
+#include "routecache.h"
+
+RouteCache::RouteCache(size_t entries) {
+    // At least two sets, the hash keeps the top bits of a 32 bit product
+    int bits = 1;
+    while (((size_t) WAYS << bits) < entries && bits < 30) {
+        bits++;
+    }
+    sets.resize((size_t) 1 << bits);
+    shift = 32 - bits;
+    clear();
+}
+
+void RouteCache::clear() {
+    for (auto &set : sets) {
+        for (auto &e : set.way) {
+            e = {0, 0, UNRESOLVED, EMPTY};
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef ROUTECACHE_H
+#define ROUTECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "fib.h"
+
+// Forwarding decisions of recently seen destinations, checked before the
+// lookup engine. Traces are skewed enough that a few thousand entries catch
+// most lines. Four-way set associative with one 64 byte line per set, so a
+// probe is a single cache line. Not thread safe, every thread has its own.
+class RouteCache {
+public:
+    static constexpr size_t WAYS = 4;
+
+    // Room for at least entries decisions, rounded up to a power of two sets
+    explicit RouteCache(size_t entries);
+
+    // Drops everything cached from an older FIB version
+    void sync(uint64_t fibVersion) {
+        if (fibVersion != version) {
+            clear();
+            version = fibVersion;
+        }
+    }
+
+    // Cached decision for dest, false on a miss
+    bool find(uint32_t dest, ForwardResult &r) {
+        const Set &set = sets[index(dest)];
+        for (size_t i = 0; i < WAYS; i++) {
+            if (set.way[i].dest == dest && set.way[i].status != EMPTY) {
+                r = set.way[i];
+                hitCount++;
+                return true;
+            }
+        }
+        missCount++;
+        return false;
+    }
+
+    // Remember r, evicting the oldest entry of its set
+    void store(const ForwardResult &r) {
+        Set &set = sets[index(r.dest)];
+        for (size_t i = WAYS - 1; i > 0; i--) {
+            set.way[i] = set.way[i - 1];
+        }
+        set.way[0] = r;
+    }
+
+    void clear();
+
+    size_t capacity() const { return sets.size() * WAYS; }
+    uint64_t hits() const { return hitCount; }
+    uint64_t misses() const { return missCount; }
+
+private:
+    static constexpr int32_t EMPTY = -1;
+
+    struct alignas(64) Set {
+        ForwardResult way[WAYS];
+    };
+
+    size_t index(uint32_t dest) const { return (size_t) ((dest * 0x9E3779B1u) >> shift); }
+
+    std::vector<Set> sets;
+    int shift;
+    uint64_t version = 0;
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+};
+
+#endif
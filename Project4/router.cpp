@@ -1,24 +1,48 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <regex>
+#include <thread>
 
 #include "router.h"
+#include "parse.h"
+#include "ipconv.h"
+#include "fib.h"
+#include "output.h"
+#include "routecache.h"
+#include "stats.h"
 
 // Helper functions
 
-// Convert string IP to num (binary)
+// Convert string IP to num (binary), 0 if it is not a dotted quad
 uint32_t ipToNum(const std::string &ipStr) {
-    uint32_t b1, b2, b3, b4;
-    char dot;
-    std::stringstream ss(ipStr);
-    ss >> b1 >> dot >> b2 >> dot >> b3 >> dot >> b4;
-    return (b1 << 24) | (b2 << 16) | (b3 << 8) | b4;
+    const char *p = ipStr.data(), *end = p + ipStr.size();
+    uint32_t ip = 0;
+    skipBlanks(p, end);
+    parseIPv4Fast(p, end, ip);
+    return ip;
+}
+
+// Destination address of one input line in [line, lineEnd). The parser may
+// look ahead up to readable, it still stops at the end of the line.
+bool readDestination(const char *line, const char *lineEnd, const char *readable, uint32_t &dest) {
+    const char *p = line;
+    skipBlanks(p, lineEnd);
+    if (!parseIPv4Fast(p, readable, dest)) {
+        WARNING << "Bad destination address " << std::string(line, lineEnd) << ", skipping to next line." << ENDL;
+        return false;
+    }
+    return true;
 }
 
 // Convert IP num to string
 std::string numToIP(uint32_t ip) {
-    return std::to_string((ip >> 24) & 0xFF) + "." + std::to_string((ip >> 16) & 0xFF) + "." + std::to_string((ip >>  8) & 0xFF) + "." + std::to_string(ip & 0xFF);
+    char buf[IPV4_BUF];
+    return std::string(buf, formatIPv4(ip, buf));
 }
 
 // Apply a network mask to an IP
@@ -30,70 +54,239 @@ uint32_t applyMask(uint32_t ip, int maskLen) {
     return ip & mask; // bitwise AND for IP and subnet mask
 }
 
+// Read a whole file into buf, one allocation however many lines it has
+static bool readFile(const std::string &path, std::string &buf) {
+    std::error_code ec;
+    std::ifstream file(path, std::ios::binary);
+    if (!file || !std::filesystem::is_regular_file(path, ec)) {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    if (size < 0) {
+        return false;
+    }
+    buf.resize((size_t) size);
+    file.seekg(0, std::ios::beg);
+    file.read(&buf[0], buf.size());
+    return (bool) file;
+}
+
+// Parse "<name> <a.b.c.d>/<len>", the whole line must match
+static bool parseInterfaceLine(const char *p, const char *end, InterfaceEntry &e) {
+    skipBlanks(p, end);
+    const char *name = p;
+    while (p < end && isalnum((unsigned char) *p)) {
+        p++;
+    }
+    if (p == name || p == end || !isBlank(*p)) {
+        return false;
+    }
+    const char *nameEnd = p;
+    skipBlanks(p, end);
+    if (!parseIPv4(p, end, e.ip) || !parseMaskLen(p, end, e.maskLen)) {
+        return false;
+    }
+    skipBlanks(p, end);
+    if (p != end) {
+        return false;
+    }
+    e.name.assign(name, nameEnd);
+    e.network = applyMask(e.ip, e.maskLen);
+    return true;
+}
+
+// Parse "<a.b.c.d>/<len> <a.b.c.d>", the whole line must match
+static bool parseRouteLine(const char *p, const char *end, RouteEntry &r) {
+    uint32_t network;
+    skipBlanks(p, end);
+    if (!parseIPv4(p, end, network) || !parseMaskLen(p, end, r.maskLen)) {
+        return false;
+    }
+    const char *gap = p;
+    skipBlanks(p, end);
+    if (p == gap || !parseIPv4(p, end, r.nextHop)) {
+        return false;
+    }
+    skipBlanks(p, end);
+    if (p != end) {
+        return false;
+    }
+    r.network = applyMask(network, r.maskLen);
+    return true;
+}
+
+// Parse "+ <a.b.c.d>/<len> <a.b.c.d>" (announce) or "- <a.b.c.d>/<len>" (withdraw)
+static bool parseUpdateLine(const char *p, const char *end, bool &withdraw, RouteEntry &r) {
+    skipBlanks(p, end);
+    if (p == end || (*p != '+' && *p != '-')) {
+        return false;
+    }
+    withdraw = *p++ == '-';
+    if (!withdraw) {
+        return parseRouteLine(p, end, r);
+    }
+
+    uint32_t network;
+    skipBlanks(p, end);
+    if (!parseIPv4(p, end, network) || !parseMaskLen(p, end, r.maskLen)) {
+        return false;
+    }
+    skipBlanks(p, end);
+    if (p != end) {
+        return false;
+    }
+    r.network = applyMask(network, r.maskLen);
+    r.nextHop = 0;
+    return true;
+}
+
+// Parse one route update line, logging what it asks for
+bool readRouteUpdate(const char *p, const char *end, bool &withdraw, RouteEntry &r) {
+    if (!parseUpdateLine(p, end, withdraw, r)) {
+        DEBUG << "Bad route update, skipping to next line." << ENDL;
+        return false;
+    }
+    if (withdraw) {
+        DEBUG << "Withdrawing route " << numToIP(r.network) << "/" << r.maskLen << ENDL;
+    } else {
+        DEBUG << "Adding route " << numToIP(r.network) << "/" << r.maskLen << " via " << numToIP(r.nextHop) << ENDL;
+    }
+    return true;
+}
+
+bool applyRouteUpdate(bool withdraw, const RouteEntry &r, Fib &fib) {
+    return withdraw ? fib.withdrawRoute(r.network, r.maskLen) : fib.addRoute(r.network, r.maskLen, r.nextHop);
+}
+
 // Check routing table file for available interfaces
-std::vector<InterfaceEntry> parseInterfaces(const std::string &path) {
-    std::vector<InterfaceEntry> interfaces;
-    std::ifstream file(path);
+bool parseInterfaces(const std::string &path, std::vector<InterfaceEntry> &interfaces) {
+    std::string buf;
 
-    if (!file) {
-        DEBUG << "Could not open interface config file." << ENDL;
-        exit(-1);
+    interfaces.clear();
+    if (!readFile(path, buf)) {
+        ERROR << "Could not open interface config file " << path << "." << ENDL;
+        return false;
     }
 
-    std::string line;
-    std::regex re(R"(^\s*([A-Za-z0-9]+)\s+([0-9\.]+)\/([0-9]+)\s*$)");
+    const char *p = buf.data(), *end = p + buf.size();
+    const char *line, *lineEnd;
 
-    while (getline(file, line)) {
+    while (nextLine(p, end, line, lineEnd)) {
         // Skip lines without any data or with comments
-        if (line.empty() || std::regex_match(line, std::regex(R"(^\s*#.*$)"))) {
+        if (line == lineEnd || isComment(line, lineEnd)) {
             continue;
         }
 
-        std::smatch match;
-        if (std::regex_match(line, match, re)) {
-            InterfaceEntry e;
-            e.name = match[1];
-            e.ip = ipToNum(match[2]);
-            e.maskLen = stoi(match[3]);
-            e.network = applyMask(e.ip, e.maskLen);
-            interfaces.push_back(e);
+        InterfaceEntry e;
+        if (parseInterfaceLine(line, lineEnd, e)) {
+            interfaces.push_back(std::move(e));
         } else {
             DEBUG << "Bad entry in configuration file, skipping to next line." << ENDL;
         }
     }
-    return interfaces;
+    return true;
 }
 
-// Check routing table for available routers
-std::vector<RouteEntry> parseRoutes(const std::string &path) {
-    std::vector<RouteEntry> routes;
-    std::ifstream file(path);
-
-    if (!file) {
-        DEBUG << "Could not open route table file." << ENDL;;
-        exit(-1);
-    }
-
-    std::string line;
-    std::regex re(R"(^\s*([0-9\.]+)\/([0-9]+)\s+([0-9\.]+)\s*$)");
+// Parse the route lines in [p, end), which starts at the beginning of a line
+static void parseRouteLines(const char *p, const char *end, std::vector<RouteEntry> &routes) {
+    // A route line such as "138.67.0.0/16 138.67.1.1" is a little under
+    // 30 bytes, so this is enough for most tables without any regrowth
+    routes.reserve((size_t) (end - p) / 24);
 
-    while (std::getline(file, line)) {
-        if (line.empty() || std::regex_match(line, std::regex(R"(^\s*#.*$)"))) {
+    const char *line, *lineEnd;
+    while (nextLine(p, end, line, lineEnd)) {
+        if (line == lineEnd || isComment(line, lineEnd)) {
             continue;
         }
 
-        std::smatch match;
-        if (std::regex_match(line, match, re)) {
-            RouteEntry r;
-            r.network = applyMask(ipToNum(match[1]), stoi(match[2]));
-            r.maskLen = stoi(match[2]);
-            r.nextHop = ipToNum(match[3]);
+        RouteEntry r;
+        if (parseRouteLine(line, lineEnd, r)) {
             routes.push_back(r);
         } else {
             DEBUG << "Bad entry in routing table file, skipping to next line." << ENDL;
         }
     }
-    return routes;
+}
+
+// Check routing table for available routers
+bool parseRoutes(const std::string &path, std::vector<RouteEntry> &routes, int threads) {
+    std::string buf;
+
+    routes.clear();
+    if (!readFile(path, buf)) {
+        ERROR << "Could not open route table file " << path << "." << ENDL;
+        return false;
+    }
+
+    // Large tables are cut into one piece per thread just after a newline,
+    // parsed side by side and joined again in file order
+    const size_t PARALLEL_MIN_BYTES = 1 << 20;
+    size_t pieces = buf.size() < PARALLEL_MIN_BYTES ? 1 : (size_t) std::max(1, threads);
+    const char *begin = buf.data(), *end = begin + buf.size();
+    std::vector<const char *> cut(1, begin);
+    for (size_t k = 1; k < pieces; k++) {
+        const char *at = std::max(cut.back(), begin + buf.size() / pieces * k);
+        const char *nl = static_cast<const char *>(memchr(at, '\n', (size_t) (end - at)));
+        cut.push_back(nl ? nl + 1 : end);
+    }
+    cut.push_back(end);
+
+    std::vector<std::vector<RouteEntry>> parts(pieces);
+    std::vector<std::thread> workers;
+    for (size_t k = 1; k < pieces; k++) {
+        workers.emplace_back(parseRouteLines, cut[k], cut[k + 1], std::ref(parts[k]));
+    }
+    parseRouteLines(cut[0], cut[1], parts[0]);
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    routes = std::move(parts[0]);
+    for (size_t k = 1; k < pieces; k++) {
+        routes.insert(routes.end(), parts[k].begin(), parts[k].end());
+    }
+    return true;
+}
+
+// Read a file of route updates, keeping the good lines in order
+bool parseRouteUpdates(const std::string &path, std::vector<RouteUpdate> &updates) {
+    std::string buf;
+
+    updates.clear();
+    if (!readFile(path, buf)) {
+        ERROR << "Could not open route update file " << path << "." << ENDL;
+        return false;
+    }
+
+    const char *p = buf.data(), *end = p + buf.size();
+    const char *line, *lineEnd;
+
+    while (nextLine(p, end, line, lineEnd)) {
+        if (line == lineEnd || isComment(line, lineEnd)) {
+            continue;
+        }
+        RouteUpdate u;
+        if (readRouteUpdate(line, lineEnd, u.withdraw, u.route)) {
+            updates.push_back(u);
+        }
+    }
+    return true;
+}
+
+// Apply a file of route updates in order
+bool applyRouteUpdates(const std::string &path, Fib &fib) {
+    std::vector<RouteUpdate> updates;
+    if (!parseRouteUpdates(path, updates)) {
+        return false;
+    }
+
+    size_t applied = 0;
+    for (auto &u : updates) {
+        applied += applyRouteUpdate(u.withdraw, u.route, fib);
+    }
+    DEBUG << "Applied " << applied << " route updates from " << path << "." << ENDL;
+    return true;
 }
 
 // Returns a pointer to best matching route or nullptr
@@ -132,154 +325,150 @@ InterfaceEntry* findOutgoingInterface(uint32_t nextHop, std::vector<InterfaceEnt
     return best;
 }
 
-void processPacket(uint32_t dest, std::vector<InterfaceEntry> &interfaces, std::vector<RouteEntry> &routes, std::ostream &out) {
-    // If destination is in the same subnet, packet should go straight there
-    bool match = false;
-    InterfaceEntry* bestMatch = nullptr;
-    int bestMask = -1;
-    for (auto &iface : interfaces) {
-        if (applyMask(dest, iface.maskLen) == iface.network) {
-            match = true;
-            if (iface.maskLen > bestMask) {
-                bestMask = iface.maskLen;
-                bestMatch = &iface;
-            }
-        }
-    }
-
-    // Go to the longest matching prefix subnet if an interface matched
-    if (match) {
-        DEBUG << "Packet on same subnet as destination." << ENDL;
-        out << numToIP(dest) << ": " << bestMatch->name << " -> " << numToIP(dest) << std::endl;
+// Print one forwarding decision in the text output format
+void writeResult(const ForwardResult &r, const Fib &fib, OutputWriter &out) {
+    if (out.isBinary()) {
+        out.putRecord({r.dest, r.iface, r.nextHop, r.status});
         return;
     }
 
-    // Find longest prefix match in routing table
-    RouteEntry *route = findRoute(dest, routes);
-
-    DEBUG << "Packet taking route " << numToIP(route->network) << ", next hop is " << numToIP(route->nextHop) << ENDL;
-
-    if (!route) {
+    if (r.status == FWD_NO_ROUTE) {
         // No route found means destination is unreachable
-        out << numToIP(dest) << ": unreachable\n";
+        out.putIP(r.dest);
+        out.put(": unreachable", 13);
+        out.endLine();
         return;
     }
 
-    // Determine interface for next hop
-    InterfaceEntry *iface = findOutgoingInterface(route->nextHop, interfaces);
-
-    DEBUG << "Packet leaving interface " << iface->name << " on " << numToIP(iface->ip) << ENDL;
-
-    if (!iface) {
+    if (r.status == FWD_NO_INTERFACE) {
         // Should only occur with malformed input
         DEBUG << "Bad interface, can't find next hop." << ENDL;
-        out << "Destination " << numToIP(dest) << " is unreachable." << std::endl;
+        out.put("Destination ", 12);
+        out.putIP(r.dest);
+        out.put(" is unreachable.", 16);
+        out.endLine();
         return;
     }
 
-    // Print forwarding information
-    out << numToIP(dest) << ": " << iface->name << " -> " << numToIP(route->nextHop) << std::endl;
-}
-
+    const InterfaceTable &ifs = fib.interfaceTable();
+    std::string_view name = ifs.name(r.iface);
 
+    // If destination is in the same subnet, packet should go straight there
+    if (r.status == FWD_CONNECTED) {
+        DEBUG << "Packet on same subnet as destination." << ENDL;
+    } else {
+        DEBUG << "Packet taking " << fib.lpm().name() << " route, next hop is " << numToIP(r.nextHop) << ENDL;
+        DEBUG << "Packet leaving interface " << name << " on " << numToIP(ifs.ip[r.iface]) << ENDL;
+    }
 
-int main(int argc, char *argv[]) {
+    // Print forwarding information
+    out.putIP(r.dest);
+    out.put(": ", 2);
+    out.put(name.data(), name.size());
+    out.put(" -> ", 4);
+    out.putIP(r.nextHop);
+    out.endLine();
+}
 
-    std::string configFile, routeFile, inputFile, outputFile;
-    int debugLevel = 4;
+void processPacket(uint32_t dest, const Fib &fib, OutputWriter &out, RouteCache *cache, ThreadStats *stats) {
+    if (stats) {
+        processBatch(&dest, 1, fib, out, cache, stats);
+        return;
+    }
 
-    for (int i = 1; i < argc; i++) {
-        std::string flag = argv[i];
-        if (flag == "-h") {
-            std::cout << "Usage: ./router -c <configFile> -r <routeTable> [-i <inputFile>] [-o <outputFile>] [-d <debugLevel>] [-h]\nDefault for input and output is stdin and stdout." << std::endl;
-            return 0;
+    // One lookup covers both connected subnets and static routes
+    ForwardResult r;
+    if (!cache) {
+        r = fib.resolve(dest);
+    } else {
+        cache->sync(fib.version());
+        if (!cache->find(dest, r)) {
+            r = fib.resolve(dest);
+            cache->store(r);
         }
+    }
+    writeResult(r, fib, out);
+}
+
+// processBatch() while counting what was decided and timing the lookups.
+// Cache hits do not know their route and only count for the interface.
+static void processBatchCounted(const uint32_t *dests, size_t n, const Fib &fib, OutputWriter &out, RouteCache *cache,
+                                ThreadStats &stats) {
+    ForwardResult results[LpmEngine::BATCH];
+    int32_t routes[LpmEngine::BATCH];
+    ForwardResult fresh[LpmEngine::BATCH];
+    int32_t freshRoutes[LpmEngine::BATCH];
+    uint32_t missed[LpmEngine::BATCH];
+    size_t missedAt[LpmEngine::BATCH];
+    if (cache) {
+        cache->sync(fib.version());
+    }
 
-        if (i + 1 < argc) {
-            std::string arg = argv[i + 1];
-
-            if (flag == "-c") {
-                configFile = arg;
-            } else if (flag == "-r") {
-                routeFile = arg;
-            } else if (flag == "-i") {
-                inputFile = arg;
-            } else if (flag == "-o") {
-                outputFile = arg;
-            } else if (flag == "-d") {
-                debugLevel = std::stoi(arg);
-            } else {
-                std::cout << "Unknown flag received, or one or more flags are missing their arguments. Use -h to see valid options." << std::endl;
-                return -1;
+    for (size_t start = 0; start < n; start += LpmEngine::BATCH) {
+        size_t count = std::min(n - start, LpmEngine::BATCH);
+        auto begin = std::chrono::steady_clock::now();
+        if (!cache) {
+            fib.resolveBatch(dests + start, results, routes, count);
+        } else {
+            size_t misses = 0;
+            for (size_t i = 0; i < count; i++) {
+                routes[i] = NO_ROUTE;
+                if (!cache->find(dests[start + i], results[i])) {
+                    missed[misses] = dests[start + i];
+                    missedAt[misses++] = i;
+                }
+            }
+            fib.resolveBatch(missed, fresh, freshRoutes, misses);
+            for (size_t i = 0; i < misses; i++) {
+                results[missedAt[i]] = fresh[i];
+                routes[missedAt[i]] = freshRoutes[i];
+                cache->store(fresh[i]);
             }
         }
-
-        i++; // Must double increment to get the next flag
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        stats.recordLookups((uint64_t) ns, count);
+        for (size_t i = 0; i < count; i++) {
+            stats.record(results[i], routes[i]);
+            writeResult(results[i], fib, out);
+        }
     }
+}
 
-    // Set debug logging level
-    LOG_LEVEL = debugLevel;;
-
-    // -c and -r are required flags
-    if (configFile == "") {
-        std::cout << "Missing configuration file! For more info, use the -h flag." << std::endl;
-    } else if (routeFile == "") {
-        std::cout << "Missing route table file! For more info, use the -h flag." << std::endl;
-    } else {
-        DEBUG << "Proper flags received." << ENDL;
+void processBatch(const uint32_t *dests, size_t n, const Fib &fib, OutputWriter &out, RouteCache *cache, ThreadStats *stats) {
+    if (stats) {
+        processBatchCounted(dests, n, fib, out, cache, *stats);
+        return;
     }
 
-    // Load config files
-    auto interfaces = parseInterfaces(configFile);
-    auto routes = parseRoutes(routeFile);
-
-
-    // Set up input to be stdin unless the -i flag was specified
-    std::istream *in = &std::cin;
-    std::ifstream fileIn;
-    if (!inputFile.empty()) {
-        fileIn.open(inputFile);
-        if (!fileIn) {
-            DEBUG << "Error: could not open input file." << ENDL;
-            return -1;
-        }
-        in = &fileIn;
-        DEBUG << "Now opening input file." << ENDL;
-    } else {
-        std::cout << "No input file specified. Ready to use stdin." << std::endl;
+    ForwardResult results[LpmEngine::BATCH];
+    ForwardResult fresh[LpmEngine::BATCH];
+    uint32_t missed[LpmEngine::BATCH];
+    size_t missedAt[LpmEngine::BATCH];
+    if (cache) {
+        cache->sync(fib.version());
     }
 
-    // Set up output to be stdout unless the -o flag was specified
-    std::ostream *out = &std::cout;
-    std::ofstream fileOut;
-    if (!outputFile.empty()) {
-        fileOut.open(outputFile);
-        if (!fileOut) {
-            DEBUG << "Error: could not open output file." << ENDL;
-            return -1;
+    for (size_t start = 0; start < n; start += LpmEngine::BATCH) {
+        size_t count = std::min(n - start, LpmEngine::BATCH);
+        if (!cache) {
+            fib.resolveBatch(dests + start, results, count);
+        } else {
+            // Only the misses go to the engine, still as one batch
+            size_t misses = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (!cache->find(dests[start + i], results[i])) {
+                    missed[misses] = dests[start + i];
+                    missedAt[misses++] = i;
+                }
+            }
+            fib.resolveBatch(missed, fresh, misses);
+            for (size_t i = 0; i < misses; i++) {
+                results[missedAt[i]] = fresh[i];
+                cache->store(fresh[i]);
+            }
         }
-        out = &fileOut;
-        DEBUG << "Now opening output file." << ENDL;
-    } else {
-        std::cout << "No output file specified. Program will use stdout.\n" << std::endl;
-    }
-
-    // Process packets per line from the input
-    std::string line;
-    while (std::getline(*in, line)) {
-        // If line has no data, continue
-        if (line.empty() || std::regex_match(line, std::regex(R"(^\s*#.*$)"))) {
-            continue;
+        for (size_t i = 0; i < count; i++) {
+            writeResult(results[i], fib, out);
         }
-
-        uint32_t dest = ipToNum(line);
-
-        processPacket(dest, interfaces, routes, *out);
     }
-
-    std::cout << "\nPackets done processing! Program will now exit." << std::endl;
-    fileIn.close();
-    fileOut.close();
-
-    return 0;
-}
\ No newline at end of file
+}
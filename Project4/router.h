@@ -20,20 +20,51 @@ struct RouteEntry {
     uint32_t nextHop;
 };
 
-uint32_t ipToUint32(const std::string &ipStr);
+uint32_t ipToNum(const std::string &ipStr);
 
-std::string uint32ToIP(uint32_t ip);
+std::string numToIP(uint32_t ip);
+
+// Parse the destination on an input line, false with a warning if there is
+// none. Both input paths skip such lines.
+bool readDestination(const char *line, const char *lineEnd, const char *readable, uint32_t &dest);
 
 uint32_t applyMask(uint32_t ip, int maskLen);
 
-std::vector<InterfaceEntry> parseInterfaces(const std::string &path);
+// Both parsers skip bad lines and return false, with an ERROR logged, only
+// when the file cannot be read
+bool parseInterfaces(const std::string &path, std::vector<InterfaceEntry> &interfaces);
 
-std::vector<RouteEntry> parseRoutes(const std::string &path);
+bool parseRoutes(const std::string &path, std::vector<RouteEntry> &routes, int threads = 1);
 
 RouteEntry* findRoute(uint32_t dest, std::vector<RouteEntry> &routes);
 
 InterfaceEntry* findOutgoingInterface(uint32_t nextHop, std::vector<InterfaceEntry> &interfaces);
 
-void processPacket(uint32_t dest, std::vector<InterfaceEntry> &interfaces, std::vector<RouteEntry> &routes, std::ostream &out, int debugLevel);
+class Fib;
+class OutputWriter;
+class RouteCache;
+struct ForwardResult;
+struct ThreadStats;
+
+// One line of a route update file, a withdrawal ignores nextHop
+struct RouteUpdate {
+    bool withdraw;
+    RouteEntry route;
+};
+
+bool parseRouteUpdates(const std::string &path, std::vector<RouteUpdate> &updates);
+
+bool applyRouteUpdates(const std::string &path, Fib &fib);
+
+bool readRouteUpdate(const char *p, const char *end, bool &withdraw, RouteEntry &r);
+
+bool applyRouteUpdate(bool withdraw, const RouteEntry &r, Fib &fib);
+
+void writeResult(const ForwardResult &r, const Fib &fib, OutputWriter &out);
+
+void processPacket(uint32_t dest, const Fib &fib, OutputWriter &out, RouteCache *cache = nullptr, ThreadStats *stats = nullptr);
+
+void processBatch(const uint32_t *dests, size_t n, const Fib &fib, OutputWriter &out, RouteCache *cache = nullptr,
+                  ThreadStats *stats = nullptr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "logging.h"
+#include "stats.h"
+
+// A client that stops reading its replies is not read from either once this
+// much is waiting for it
+static const size_t MAX_PENDING = 4 << 20;
+
+static const size_t HEADER = 4;
+static const size_t RECORD = 16;
+
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static uint32_t readBig(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+static void appendBig(std::vector<char> &out, uint32_t v) {
+    v = htonl(v);
+    const char *p = reinterpret_cast<const char *>(&v);
+    out.insert(out.end(), p, p + sizeof(v));
+}
+
+LookupServer::~LookupServer() {
+    for (auto &c : clients) {
+        close(c.first);
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        if (!socketPath.empty()) {
+            unlink(socketPath.c_str());
+        }
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+}
+
+bool LookupServer::listen(const std::string &where) {
+    udp = !where.empty() && std::all_of(where.begin(), where.end(), [](char c) { return c >= '0' && c <= '9'; });
+    if (udp) {
+        long port = std::stol(where);
+        listenFd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons((uint16_t) port);
+        if (port < 1 || port > 65535 || listenFd < 0 || bind(listenFd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+            ERROR << "Could not listen on UDP port " << where << ": " << strerror(errno) << "." << ENDL;
+            return false;
+        }
+    } else {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (where.size() >= sizeof(addr.sun_path)) {
+            ERROR << "Socket path " << where << " is too long." << ENDL;
+            return false;
+        }
+        strcpy(addr.sun_path, where.c_str());
+        unlink(where.c_str());
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 || bind(listenFd, (sockaddr *) &addr, sizeof(addr)) < 0 || ::listen(listenFd, 128) < 0) {
+            ERROR << "Could not listen on " << where << ": " << strerror(errno) << "." << ENDL;
+            return false;
+        }
+        socketPath = where;
+    }
+
+    epollFd = epoll_create1(0);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    if (!setNonBlocking(listenFd) || epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0) {
+        ERROR << "Could not set up the event loop: " << strerror(errno) << "." << ENDL;
+        return false;
+    }
+    return true;
+}
+
+bool LookupServer::run(std::function<bool()> keepGoing) {
+    epoll_event events[64];
+    while (keepGoing()) {
+        int n = epoll_wait(epollFd, events, 64, POLL_MS);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERROR << "Event loop failed: " << strerror(errno) << "." << ENDL;
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                if (udp) {
+                    readDatagrams();
+                } else {
+                    accept();
+                }
+                continue;
+            }
+
+            auto it = clients.find(fd);
+            if (it == clients.end()) {
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                drop(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                writeStream(fd, it->second);
+            }
+            // Writing may have dropped the client
+            it = clients.find(fd);
+            if (it != clients.end() && (events[i].events & EPOLLIN)) {
+                readStream(fd, it->second);
+            }
+        }
+    }
+    return true;
+}
+
+void LookupServer::accept() {
+    while (true) {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                WARNING << "Could not accept a client: " << strerror(errno) << "." << ENDL;
+            }
+            return;
+        }
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (!setNonBlocking(fd) || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        clients[fd];
+        DEBUG << "Client " << fd << " connected." << ENDL;
+    }
+}
+
+void LookupServer::drop(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clients.erase(fd);
+    DEBUG << "Client " << fd << " disconnected." << ENDL;
+}
+
+void LookupServer::readStream(int fd, Client &c) {
+    char buf[65536];
+    ssize_t got = read(fd, buf, sizeof(buf));
+    if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        drop(fd);
+        return;
+    }
+    if (got < 0) {
+        return;
+    }
+    c.in.insert(c.in.end(), buf, buf + got);
+
+    // Answer every complete request, a partial one waits for more bytes
+    size_t pos = 0;
+    while (c.in.size() - pos >= HEADER) {
+        uint32_t count = readBig(&c.in[pos]);
+        if (count > MAX_COUNT) {
+            DEBUG << "Client " << fd << " asked for " << count << " lookups at once, disconnecting." << ENDL;
+            drop(fd);
+            return;
+        }
+        if (c.in.size() - pos < HEADER + (size_t) count * 4) {
+            break;
+        }
+        answer(&c.in[pos + HEADER], count, c.out);
+        pos += HEADER + (size_t) count * 4;
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + pos);
+    writeStream(fd, c);
+}
+
+void LookupServer::writeStream(int fd, Client &c) {
+    while (c.outSent < c.out.size()) {
+        ssize_t sent = send(fd, c.out.data() + c.outSent, c.out.size() - c.outSent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                drop(fd);
+                return;
+            }
+            break;
+        }
+        c.outSent += (size_t) sent;
+    }
+    if (c.outSent == c.out.size()) {
+        c.out.clear();
+        c.outSent = 0;
+    }
+
+    // Wait for room when replies are left over, and stop reading requests
+    // from a client that lets too many of them pile up
+    bool writing = !c.out.empty();
+    uint32_t wanted = (c.out.size() - c.outSent < MAX_PENDING ? uint32_t(EPOLLIN) : 0) | (writing ? uint32_t(EPOLLOUT) : 0);
+    if (writing || c.writing) {
+        epoll_event ev = {};
+        ev.events = wanted;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    c.writing = writing;
+}
+
+void LookupServer::readDatagrams() {
+    char buf[HEADER + UDP_MAX_COUNT * 4];
+    std::vector<char> reply;
+    while (true) {
+        sockaddr_storage from;
+        socklen_t fromLen = sizeof(from);
+        ssize_t got = recvfrom(listenFd, buf, sizeof(buf), MSG_TRUNC, (sockaddr *) &from, &fromLen);
+        if (got < 0) {
+            return;
+        }
+        uint32_t count = got >= (ssize_t) HEADER ? readBig(buf) : 0;
+        if (got < (ssize_t) HEADER || count > UDP_MAX_COUNT || (size_t) got != HEADER + (size_t) count * 4) {
+            DEBUG << "Ignoring a malformed request of " << got << " bytes." << ENDL;
+            continue;
+        }
+        reply.clear();
+        answer(buf + HEADER, count, reply);
+        sendto(listenFd, reply.data(), reply.size(), 0, (sockaddr *) &from, fromLen);
+    }
+}
+
+void LookupServer::answer(const char *req, uint32_t count, std::vector<char> &reply) {
+    dests.resize(count);
+    results.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        dests[i] = readBig(req + 4 * (size_t) i);
+    }
+    if (stats) {
+        routes.resize(count);
+        for (size_t start = 0; start < count; start += LpmEngine::BATCH) {
+            size_t n = std::min((size_t) count - start, LpmEngine::BATCH);
+            auto begin = std::chrono::steady_clock::now();
+            fib.resolveBatch(&dests[start], &results[start], &routes[start], n);
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+            stats->recordLookups((uint64_t) ns, n);
+            for (size_t i = start; i < start + n; i++) {
+                stats->record(results[i], routes[i]);
+            }
+        }
+    } else {
+        fib.resolveBatch(dests.data(), results.data(), count);
+    }
+
+    reply.reserve(reply.size() + HEADER + (size_t) count * RECORD);
+    appendBig(reply, count);
+    for (const ForwardResult &r : results) {
+        appendBig(reply, r.dest);
+        appendBig(reply, r.nextHop);
+        appendBig(reply, (uint32_t) r.iface);
+        appendBig(reply, (uint32_t) r.status);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "fib.h"
+
+struct ThreadStats;
+
+// Answers lookups for other programs from one FIB that stays loaded, on a
+// UNIX stream socket or a UDP port, with a single epoll loop serving any
+// number of clients. A request is a batch of addresses and gets exactly one
+// reply, all integers big endian:
+//
+//   request  uint32 count, then count IPv4 addresses
+//   reply    uint32 count, then count records of
+//            uint32 dest, uint32 nextHop, int32 iface, int32 status
+//
+// iface is the interface's line in the config file counting from 0, status
+// is one of FWD_GATEWAY, FWD_CONNECTED, FWD_NO_ROUTE or FWD_NO_INTERFACE.
+// Stream clients may send requests back to back without waiting for the
+// replies. Over UDP every datagram is one request of at most UDP_MAX_COUNT.
+class LookupServer {
+public:
+    static constexpr uint32_t MAX_COUNT = 65536;
+    static constexpr uint32_t UDP_MAX_COUNT = 4000;
+    static constexpr int POLL_MS = 1000;
+
+    LookupServer(const Fib &fib, ThreadStats *stats = nullptr) : fib(fib), stats(stats) {}
+    ~LookupServer();
+    LookupServer(const LookupServer &) = delete;
+    LookupServer &operator=(const LookupServer &) = delete;
+
+    // Listen on where, a UDP port when it is a number and otherwise the path
+    // of a UNIX socket, which is replaced if it exists
+    bool listen(const std::string &where);
+
+    // Serve until keepGoing() returns false. It is asked after every round
+    // of events, whenever a signal interrupts the wait, and at least every
+    // POLL_MS when there is nothing to do.
+    bool run(std::function<bool()> keepGoing);
+
+private:
+    struct Client {
+        std::vector<char> in;
+        std::vector<char> out;
+        size_t outSent = 0;
+        bool writing = false;   // waiting for room to send
+    };
+
+    void accept();
+    void readStream(int fd, Client &c);
+    void writeStream(int fd, Client &c);
+    void readDatagrams();
+    void drop(int fd);
+
+    // Append the reply for count big endian addresses at req to reply
+    void answer(const char *req, uint32_t count, std::vector<char> &reply);
+
+    const Fib &fib;
+    ThreadStats *stats;
+    int epollFd = -1;
+    int listenFd = -1;
+    bool udp = false;
+    std::string socketPath;
+    std::unordered_map<int, Client> clients;
+    std::vector<uint32_t> dests;
+    std::vector<ForwardResult> results;
+    std::vector<int32_t> routes;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sharedfib.h"
+#include "logging.h"
+
+namespace {
+
+constexpr char MAGIC[8] = {'R', 'T', 'R', 'S', 'H', 'M', '\r', '\n'};
+
+}
+
+struct SharedFib::Control {
+    char magic[8];
+    std::atomic<uint64_t> generation;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the generation counter is shared between processes");
+
+static std::string segmentName(const std::string &name) {
+    return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
+
+static std::string generationName(const std::string &segment, uint64_t generation) {
+    return segment + "." + std::to_string(generation);
+}
+
+// Create the segment name holding a copy of image, failing if it exists
+static bool writeSegment(const std::string &name, const std::string &image) {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ftruncate(fd, (off_t) image.size()) == 0;
+    void *p = ok ? mmap(nullptr, image.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+    memcpy(p, image.data(), image.size());
+    munmap(p, image.size());
+    return true;
+}
+
+bool SharedFib::publish(const std::string &name, const Fib &fib, uint64_t &generation) {
+    std::string segment = segmentName(name);
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || ((size_t) st.st_size < sizeof(Control) &&
+                                         ftruncate(fd, sizeof(Control)) < 0)) {
+        ERROR << "Could not create shared memory segment " << segment << ": " << strerror(errno) << "." << ENDL;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    void *p = mmap(nullptr, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        ERROR << "Could not map shared memory segment " << segment << ": " << strerror(errno) << "." << ENDL;
+        return false;
+    }
+
+    // A segment that was just created is all zeroes
+    Control *control = static_cast<Control *>(p);
+    static const char blank[sizeof(MAGIC)] = {};
+    if (memcmp(control->magic, MAGIC, sizeof(MAGIC)) != 0) {
+        if (memcmp(control->magic, blank, sizeof(blank)) != 0) {
+            ERROR << "Shared memory segment " << segment << " does not hold a FIB." << ENDL;
+            munmap(p, sizeof(Control));
+            return false;
+        }
+        memcpy(control->magic, MAGIC, sizeof(MAGIC));
+    }
+
+    // The image is complete before the counter points readers at it
+    uint64_t previous = control->generation.load(std::memory_order_acquire);
+    generation = previous + 1;
+    std::string next = generationName(segment, generation);
+    shm_unlink(next.c_str());  // left behind by a publisher that died
+    if (!writeSegment(next, fib.snapshotImage())) {
+        ERROR << "Could not write shared memory segment " << next << ": " << strerror(errno) << "." << ENDL;
+        munmap(p, sizeof(Control));
+        return false;
+    }
+    control->generation.store(generation, std::memory_order_release);
+    munmap(p, sizeof(Control));
+
+    if (previous > 0) {
+        shm_unlink(generationName(segment, previous).c_str());
+    }
+    return true;
+}
+
+SharedFib::~SharedFib() {
+    if (control) {
+        munmap(const_cast<Control *>(control), sizeof(Control));
+    }
+}
+
+bool SharedFib::open(const std::string &name) {
+    segment = segmentName(name);
+    int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(Control)) {
+        ERROR << "No FIB has been published as " << segment << "." << ENDL;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    void *p = mmap(nullptr, sizeof(Control), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        ERROR << "Could not map shared memory segment " << segment << ": " << strerror(errno) << "." << ENDL;
+        return false;
+    }
+    control = static_cast<const Control *>(p);
+    if (memcmp(control->magic, MAGIC, sizeof(MAGIC)) != 0) {
+        ERROR << "Shared memory segment " << segment << " does not hold a FIB." << ENDL;
+        return false;
+    }
+    return true;
+}
+
+uint64_t SharedFib::generation() const {
+    return control->generation.load(std::memory_order_acquire);
+}
+
+std::shared_ptr<MappedFile> SharedFib::attach(uint64_t &gen) const {
+    std::shared_ptr<MappedFile> map(new MappedFile());
+    uint64_t current = generation();
+    while (current > 0) {
+        if (map->openShared(generationName(segment, current))) {
+            gen = current;
+            return map;
+        }
+        // A newer generation may have replaced this one since it was read
+        uint64_t again = generation();
+        if (again == current) {
+            break;
+        }
+        current = again;
+    }
+    ERROR << "Could not map the current FIB of " << segment << "." << ENDL;
+    return nullptr;
+}
+
+std::shared_ptr<MappedFile> SharedFib::attachChecked(uint64_t &gen, const std::string &lpmName, bool tracking) const {
+    gen = generation();
+    std::shared_ptr<MappedFile> map = attach(gen);
+    Fib scratch;
+    scratch.setRouteTracking(tracking);
+    if (!map || !scratch.attachImage(map->data(), map->size(), lpmName, map)) {
+        return nullptr;
+    }
+    return map;
+}
@@ -0,0 +1,55 @@
+#ifndef SHAREDFIB_H
+#define SHAREDFIB_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "fib.h"
+#include "mmapfile.h"
+
+// A FIB built once and shared by any number of router processes through
+// POSIX shared memory. Each generation is a snapshot image (see snapshot.cpp)
+// in its own segment, "<name>.<generation>", which readers map read-only
+// and look up in place. A small control segment under name itself holds the
+// generation that is current. Publishing writes the new segment completely,
+// then bumps the counter, then unlinks the old segment; processes that
+// still have the old one mapped keep it until they move on.
+//
+// Names follow shm_open(): a leading '/' and no other, one is added when
+// it is missing. There should be one publisher at a time.
+class SharedFib {
+public:
+    // Publish fib as the next generation of name, which is created if
+    // needed, and store that generation
+    static bool publish(const std::string &name, const Fib &fib, uint64_t &generation);
+
+    SharedFib() = default;
+    ~SharedFib();
+    SharedFib(const SharedFib &) = delete;
+    SharedFib &operator=(const SharedFib &) = delete;
+
+    // Map the control segment of name, false if nothing was published there
+    bool open(const std::string &name);
+
+    // The generation published now, 0 if there is none yet
+    uint64_t generation() const;
+
+    // Map the image of the generation published now and store that
+    // generation, nullptr if it cannot be mapped
+    std::shared_ptr<MappedFile> attach(uint64_t &gen) const;
+
+    // attach(), checked by loading the image into a scratch FIB set up like
+    // the one it is for, so a broken image never replaces a working one.
+    // gen is the generation that was tried, whether it loaded or not.
+    std::shared_ptr<MappedFile> attachChecked(uint64_t &gen, const std::string &lpmName, bool tracking) const;
+
+    const std::string &name() const { return segment; }
+
+private:
+    struct Control;
+
+    std::string segment;
+    const Control *control = nullptr;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include <algorithm>
+
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LPM_X86 1
+#endif
+
+namespace {
+
+enum SimdLevel { SCALAR = 0, AVX2 = 1, AVX512 = 2 };
+
+int detectLevel() {
+#ifdef LPM_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        return AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2;
+    }
+#endif
+    return SCALAR;
+}
+
+uint32_t bestKeyScalar(uint32_t dest, const uint32_t *network, const uint32_t *mask, const uint32_t *key, size_t n) {
+    uint32_t best = 0;
+    for (size_t i = 0; i < n; i++) {
+        if ((dest & mask[i]) == network[i] && key[i] > best) {
+            best = key[i];
+        }
+    }
+    return best;
+}
+
+#ifdef LPM_X86
+
+__attribute__((target("avx2")))
+uint32_t bestKeyAvx2(uint32_t dest, const uint32_t *network, const uint32_t *mask, const uint32_t *key, size_t n) {
+    __m256i d = _mm256_set1_epi32((int) dest);
+    __m256i best = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += 8) {
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(mask + i));
+        __m256i net = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(network + i));
+        __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i));
+        __m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(d, m), net);
+        best = _mm256_max_epu32(best, _mm256_and_si256(hit, k));
+    }
+
+    // Horizontal max of the 8 lanes
+    __m128i x = _mm_max_epu32(_mm256_castsi256_si128(best), _mm256_extracti128_si256(best, 1));
+    x = _mm_max_epu32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_max_epu32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t) _mm_cvtsi128_si32(x);
+}
+
+__attribute__((target("avx512f")))
+uint32_t bestKeyAvx512(uint32_t dest, const uint32_t *network, const uint32_t *mask, const uint32_t *key, size_t n) {
+    __m512i d = _mm512_set1_epi32((int) dest);
+    __m512i best = _mm512_setzero_si512();
+    for (size_t i = 0; i < n; i += 16) {
+        __m512i m = _mm512_loadu_si512(mask + i);
+        __m512i net = _mm512_loadu_si512(network + i);
+        __m512i k = _mm512_loadu_si512(key + i);
+        __mmask16 hit = _mm512_cmpeq_epi32_mask(_mm512_and_si512(d, m), net);
+        best = _mm512_mask_max_epu32(best, hit, best, k);
+    }
+    return _mm512_reduce_max_epu32(best);
+}
+
+#endif
+
+}
+
+bool SimdLinearEngine::build(const PrefixTable &prefixes) {
+    if (prefixes.size() > MAX_PREFIXES) {
+        ERROR << "Too many prefixes for the simd engine (" << prefixes.size() << ")." << ENDL;
+        return false;
+    }
+
+    size_t padded = (prefixes.size() + 15) & ~(size_t) 15;
+    network.assign(prefixes.network.begin(), prefixes.network.end());
+    mask.assign(prefixes.mask.begin(), prefixes.mask.end());
+    hop.assign(prefixes.hop.begin(), prefixes.hop.end());
+    key.resize(prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        key[i] = ((uint32_t) (prefixes.maskLen[i] + 1) << 16) | (uint32_t) (0xFFFF - i);
+    }
+
+    // Padding lanes match everything but have key 0, so they never win
+    network.resize(padded, 0);
+    mask.resize(padded, 0);
+    key.resize(padded, 0);
+
+    level = detectLevel();
+    return true;
+}
+
+int SimdLinearEngine::lookup(uint32_t dest) const {
+    uint32_t best;
+#ifdef LPM_X86
+    if (level == AVX512) {
+        best = bestKeyAvx512(dest, network.data(), mask.data(), key.data(), key.size());
+    } else if (level == AVX2) {
+        best = bestKeyAvx2(dest, network.data(), mask.data(), key.data(), key.size());
+    } else
+#endif
+    {
+        best = bestKeyScalar(dest, network.data(), mask.data(), key.data(), key.size());
+    }
+    return best ? hop[0xFFFF - (best & 0xFFFF)] : NO_ROUTE;
+}
+
+size_t SimdLinearEngine::memoryUsage() const {
+    return (network.capacity() + mask.capacity() + key.capacity()) * sizeof(uint32_t) + hop.capacity() * sizeof(int32_t);
+}
+
+const char *SimdLinearEngine::isa() const {
+    static const char *names[] = {"scalar", "avx2", "avx512"};
+    return names[level];
+}
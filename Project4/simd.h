@@ -0,0 +1,40 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstdint>
+#include <vector>
+#include "lpm.h"
+
+// Brute force longest prefix match that compares one destination against 16
+// (AVX-512) or 8 (AVX2) prefixes per instruction. For the few hundred prefixes
+// of an edge router this beats walking a trie, there are no dependent loads.
+//
+// Each prefix gets a key of (mask length + 1) << 16 | (0xFFFF - index), so
+// the largest key among the matching prefixes is the longest mask, and the
+// earliest prefix on ties, just like findRoute(). Non-matching lanes count
+// as 0, which is why tables are limited to MAX_PREFIXES.
+class SimdLinearEngine : public LpmEngine {
+public:
+    const char *name() const override { return "simd"; }
+    bool build(const PrefixTable &prefixes) override;
+    int lookup(uint32_t dest) const override;
+    size_t memoryUsage() const override;
+
+    // Instruction set the lookups run on: "avx512", "avx2" or "scalar"
+    const char *isa() const;
+
+    static constexpr size_t MAX_PREFIXES = 0xFFFF;
+
+    // Below this many prefixes --lpm=auto picks this engine over the trie
+    static constexpr size_t AUTO_THRESHOLD = 256;
+
+private:
+    // Padded to a multiple of 16 with entries that never match
+    std::vector<uint32_t> network;
+    std::vector<uint32_t> mask;
+    std::vector<uint32_t> key;
+    std::vector<int32_t> hop;
+    int level = 0;
+};
+
+#endif
@@ -0,0 +1,307 @@
+/*
+    Binary FIB snapshots, written with router --compile and loaded with -f.
+    --shm-publish puts the same image in shared memory (see sharedfib.h).
+
+    Layout, all little endian and every section 64 byte aligned:
+
+        Header         magic, version, byte order mark, sizes, checksum,
+                       name of the lookup engine that was built
+        Section[n]     id, offset from the start of the file, size in bytes
+        section data   the Fib arrays, then the engine's exported arrays
+
+    The checksum covers everything after the header. Offsets are relative to
+    the file, so the image can be used wherever it is mapped.
+*/
+
+#include <cstring>
+#include <fstream>
+
+#include "fib.h"
+#include "mmapfile.h"
+#include "snapshot.h"
+
+namespace {
+
+constexpr char MAGIC[8] = {'R', 'T', 'R', 'F', 'I', 'B', '\r', '\n'};
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr size_t ALIGN = 64;
+
+enum SectionId : uint32_t {
+    IF_IP = 1,
+    IF_NETWORK,
+    IF_MASKLEN,
+    IF_NAMESTART,
+    IF_NAMES,
+    PFX_NETWORK,
+    PFX_MASK,
+    PFX_MASKLEN,
+    PFX_HOP,
+    HOP_ADDR,
+    HOP_IFACE,
+    HOP_CONNECTED,
+    ENGINE_ARRAY = 0x100,  // engine array n is ENGINE_ARRAY + n
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    uint64_t checksum;
+    uint32_t sectionCount;
+    uint32_t reserved;
+    char engine[24];
+};
+static_assert(sizeof(Header) == 64, "snapshot header layout");
+
+struct Section {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Parts of an image to be written, in order
+struct Piece {
+    uint32_t id;
+    const void *data;
+    size_t size;
+};
+
+template <typename T>
+Piece piece(uint32_t id, const std::vector<T> &v) {
+    return {id, v.data(), v.size() * sizeof(T)};
+}
+
+// Section table entry with the given id, nullptr if it is missing
+const Section *findSection(const Section *table, uint32_t count, uint32_t id) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (table[i].id == id) {
+            return &table[i];
+        }
+    }
+    return nullptr;
+}
+
+template <typename T>
+bool readSection(const char *base, const Section *table, uint32_t count, uint32_t id, std::vector<T> &out) {
+    const Section *s = findSection(table, count, id);
+    if (!s || s->size % sizeof(T)) {
+        return false;
+    }
+    const T *p = reinterpret_cast<const T *>(base + s->offset);
+    out.assign(p, p + s->size / sizeof(T));
+    return true;
+}
+
+}
+
+uint64_t snapshotChecksum(const char *data, size_t n) {
+    // Four independent multiply-xor lanes over 8 byte words, then the tail.
+    // Meant to catch truncation and corruption, not tampering.
+    const uint64_t K = 0x9E3779B97F4A7C15ull;
+    uint64_t lane[4] = {1, 2, 3, 4};
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int j = 0; j < 4; j++) {
+            uint64_t w;
+            memcpy(&w, data + i + 8 * j, 8);
+            lane[j] = (lane[j] ^ w) * K;
+            lane[j] ^= lane[j] >> 29;
+        }
+    }
+    uint64_t h = n;
+    for (int j = 0; j < 4; j++) {
+        h = (h ^ lane[j]) * K;
+    }
+    for (; i < n; i++) {
+        h = (h ^ (unsigned char) data[i]) * K;
+    }
+    return h ^ (h >> 31);
+}
+
+std::string Fib::snapshotImage() const {
+    std::vector<uint8_t> connected(hops.connected.begin(), hops.connected.end());
+    std::vector<Piece> pieces = {
+        piece(IF_IP, interfaces.ip),
+        piece(IF_NETWORK, interfaces.network),
+        piece(IF_MASKLEN, interfaces.maskLen),
+        piece(IF_NAMESTART, interfaces.nameStart),
+        {IF_NAMES, interfaces.names.data(), interfaces.names.size()},
+        piece(PFX_NETWORK, prefixes.network),
+        piece(PFX_MASK, prefixes.mask),
+        piece(PFX_MASKLEN, prefixes.maskLen),
+        piece(PFX_HOP, prefixes.hop),
+        piece(HOP_ADDR, hops.addrs),
+        piece(HOP_IFACE, hops.iface),
+        piece(HOP_CONNECTED, connected),
+    };
+    // Engine arrays numbered by position for route tracking are no use to -f
+    auto arrays = tracking ? std::vector<std::pair<const void *, size_t>>() : engine->exportArrays();
+    for (size_t i = 0; i < arrays.size(); i++) {
+        pieces.push_back({(uint32_t) (ENGINE_ARRAY + i), arrays[i].first, arrays[i].second});
+    }
+
+    // Lay the whole image out in memory, then checksum and write it at once
+    size_t offset = sizeof(Header) + pieces.size() * sizeof(Section);
+    std::vector<Section> table;
+    for (auto &p : pieces) {
+        offset = (offset + ALIGN - 1) & ~(ALIGN - 1);
+        table.push_back({p.id, 0, offset, p.size});
+        offset += p.size;
+    }
+
+    std::string image(offset, '\0');
+    for (size_t i = 0; i < pieces.size(); i++) {
+        if (pieces[i].size) {
+            memcpy(&image[table[i].offset], pieces[i].data, pieces[i].size);
+        }
+    }
+    memcpy(&image[sizeof(Header)], table.data(), table.size() * sizeof(Section));
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = SNAPSHOT_VERSION;
+    h.byteOrder = BYTE_ORDER_MARK;
+    h.fileSize = image.size();
+    h.sectionCount = (uint32_t) table.size();
+    strncpy(h.engine, engine->name(), sizeof(h.engine) - 1);
+    h.checksum = snapshotChecksum(image.data() + sizeof(Header), image.size() - sizeof(Header));
+    memcpy(&image[0], &h, sizeof(h));
+    return image;
+}
+
+bool Fib::save(const std::string &path) const {
+    std::string image = snapshotImage();
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(image.data(), image.size())) {
+        ERROR << "Could not write FIB snapshot " << path << "." << ENDL;
+        return false;
+    }
+    return true;
+}
+
+bool Fib::load(const std::string &path, const std::string &lpmName) {
+    std::shared_ptr<MappedFile> map(new MappedFile());
+    if (!map->open(path)) {
+        ERROR << "Could not open FIB snapshot " << path << "." << ENDL;
+        return false;
+    }
+    const char *base = map->data();
+    size_t size = map->size();
+    return attachImage(base, size, lpmName, std::move(map));
+}
+
+bool Fib::attachImage(const char *base, size_t size, const std::string &lpmName, std::shared_ptr<MappedFile> owner) {
+    Header h;
+    if (size < sizeof(Header)) {
+        ERROR << "FIB snapshot is truncated." << ENDL;
+        return false;
+    }
+    memcpy(&h, base, sizeof(h));
+    if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.byteOrder != BYTE_ORDER_MARK) {
+        ERROR << "Not a FIB snapshot, or written on a machine with another byte order." << ENDL;
+        return false;
+    }
+    if (h.version != SNAPSHOT_VERSION) {
+        ERROR << "FIB snapshot version " << h.version << " is not supported, expected " << SNAPSHOT_VERSION << "." << ENDL;
+        return false;
+    }
+    if (h.fileSize != size || size - sizeof(Header) < (uint64_t) h.sectionCount * sizeof(Section)) {
+        ERROR << "FIB snapshot is truncated." << ENDL;
+        return false;
+    }
+    if (snapshotChecksum(base + sizeof(Header), size - sizeof(Header)) != h.checksum) {
+        ERROR << "FIB snapshot checksum does not match, the file is corrupt." << ENDL;
+        return false;
+    }
+
+    const Section *table = reinterpret_cast<const Section *>(base + sizeof(Header));
+    for (uint32_t i = 0; i < h.sectionCount; i++) {
+        if (table[i].offset > size || table[i].size > size - table[i].offset) {
+            ERROR << "FIB snapshot section " << table[i].id << " is out of bounds." << ENDL;
+            return false;
+        }
+    }
+
+    // Everything goes into a scratch FIB first, this one only changes once
+    // the whole snapshot loaded
+    Fib next;
+    next.tracking = tracking;
+    InterfaceTable &ifs = next.interfaces;
+    PrefixTable &pfx = next.prefixes;
+    NextHopTable &nh = next.hops;
+    std::vector<uint8_t> connected;
+    std::vector<uint8_t> nameBytes;
+    bool ok = readSection(base, table, h.sectionCount, IF_IP, ifs.ip)
+        && readSection(base, table, h.sectionCount, IF_NETWORK, ifs.network)
+        && readSection(base, table, h.sectionCount, IF_MASKLEN, ifs.maskLen)
+        && readSection(base, table, h.sectionCount, IF_NAMESTART, ifs.nameStart)
+        && readSection(base, table, h.sectionCount, IF_NAMES, nameBytes)
+        && readSection(base, table, h.sectionCount, PFX_NETWORK, pfx.network)
+        && readSection(base, table, h.sectionCount, PFX_MASK, pfx.mask)
+        && readSection(base, table, h.sectionCount, PFX_MASKLEN, pfx.maskLen)
+        && readSection(base, table, h.sectionCount, PFX_HOP, pfx.hop)
+        && readSection(base, table, h.sectionCount, HOP_ADDR, nh.addrs)
+        && readSection(base, table, h.sectionCount, HOP_IFACE, nh.iface)
+        && readSection(base, table, h.sectionCount, HOP_CONNECTED, connected);
+    ifs.names.assign(nameBytes.begin(), nameBytes.end());
+    nh.connected.assign(connected.begin(), connected.end());
+
+    // Everything the lookups index must be in range
+    size_t nIf = ifs.ip.size(), nPfx = pfx.network.size(), nHop = nh.addrs.size();
+    ok = ok && ifs.network.size() == nIf && ifs.maskLen.size() == nIf
+        && ifs.nameStart.size() == nIf + 1 && ifs.nameStart.back() <= ifs.names.size()
+        && pfx.mask.size() == nPfx && pfx.maskLen.size() == nPfx && pfx.hop.size() == nPfx
+        && nh.iface.size() == nHop && nh.connected.size() == nHop;
+    for (size_t i = 0; ok && i < nIf; i++) {
+        ok = ifs.nameStart[i] <= ifs.nameStart[i + 1];
+    }
+    for (size_t i = 0; ok && i < nPfx; i++) {
+        ok = pfx.hop[i] >= 0 && (size_t) pfx.hop[i] < nHop && pfx.maskLen[i] <= 32;
+    }
+    for (size_t i = 0; ok && i < nHop; i++) {
+        ok = nh.iface[i] == UNRESOLVED || (nh.iface[i] >= 0 && (size_t) nh.iface[i] < nIf);
+    }
+    if (!ok) {
+        ERROR << "FIB snapshot tables are inconsistent." << ENDL;
+        return false;
+    }
+    nh.reindex();
+    next.indexPrefixes();
+    next.assignRouteIds();
+
+    // Reuse the stored engine arrays in place when possible, otherwise build
+    std::string stored(h.engine, strnlen(h.engine, sizeof(h.engine)));
+    bool sameEngine = lpmName == "auto" || lpmName == stored;
+    next.engine = makeEngine(sameEngine ? stored : lpmName, nPfx);
+    if (!next.engine) {
+        ERROR << "Unknown lookup engine " << (sameEngine ? stored : lpmName) << "." << ENDL;
+        return false;
+    }
+
+    std::vector<std::pair<const void *, size_t>> arrays;
+    for (uint32_t n = 0; sameEngine && !tracking; n++) {
+        const Section *s = findSection(table, h.sectionCount, ENGINE_ARRAY + n);
+        if (!s) {
+            break;
+        }
+        arrays.push_back({base + s->offset, s->size});
+    }
+    if (!arrays.empty() && next.engine->attachArrays(arrays, nHop)) {
+        DEBUG << "Using the " << stored << " tables inside the snapshot." << ENDL;
+        next.mapping = std::move(owner);
+    } else {
+        if (!arrays.empty()) {
+            WARNING << "The " << stored << " tables inside the snapshot are inconsistent, rebuilding them." << ENDL;
+        }
+        if (!next.installEngine(std::move(next.engine))) {
+            return false;
+        }
+    }
+
+    next.changes = changes + 1;
+    *this = std::move(next);
+    return true;
+}
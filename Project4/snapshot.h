@@ -0,0 +1,13 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Format version written by Fib::save(), bumped on any layout change
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+// Checksum stored in, and verified against, every snapshot
+uint64_t snapshotChecksum(const char *data, size_t n);
+
+#endif
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <fstream>
+#include <string_view>
+#include <utility>
+#include "stats.h"
+#include "hugepages.h"
+#include "router.h"
+
+// Slack after each counter array, so the next allocation never shares the
+// cache line of its last counter
+static const size_t LINE_SLACK = 64 / sizeof(uint64_t);
+
+static const char *PHASE_NAMES[Stats::PHASES] = {"parse", "load", "build", "updates", "forward", "total"};
+
+ThreadStats::ThreadStats(size_t routeCapacity, size_t interfaces)
+    : routeCapacity(routeCapacity), ifaceCount(interfaces), routes(routeCapacity + LINE_SLACK),
+      ifaces(interfaces + LINE_SLACK) {
+}
+
+ThreadStats *Stats::registerThread(const Fib &fib) {
+    size_t routes = fib.routeTracking() ? fib.trackedRoutes().size() + 65536 : 0;
+    std::unique_ptr<ThreadStats> t(new ThreadStats(routes, fib.interfaceTable().size()));
+    std::lock_guard<std::mutex> guard(lock);
+    threads.push_back(std::move(t));
+    return threads.back().get();
+}
+
+void Stats::addPhase(Phase p, double ms) {
+    std::lock_guard<std::mutex> guard(lock);
+    phaseMs[p] += ms;
+}
+
+static void writeString(std::ostream &out, std::string_view s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        if ((unsigned char) c >= 0x20) {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+static uint64_t sum(const std::vector<ThreadStats *> &threads, std::atomic<uint64_t> ThreadStats::*field) {
+    uint64_t total = 0;
+    for (auto *t : threads) {
+        total += (t->*field).load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+bool Stats::write(const std::string &path, const Fib &fib) {
+    std::vector<ThreadStats *> all;
+    double phases[PHASES];
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto &t : threads) {
+            all.push_back(t.get());
+        }
+        std::copy(phaseMs, phaseMs + PHASES, phases);
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        ERROR << "Could not write statistics to " << path << "." << ENDL;
+        return false;
+    }
+
+    uint64_t lookups = sum(all, &ThreadStats::lookups);
+    uint64_t lookupNs = sum(all, &ThreadStats::lookupNs);
+    out << "{\n  \"phases_ms\": {";
+    for (int p = 0; p < PHASES; p++) {
+        out << (p ? ", " : "") << '"' << PHASE_NAMES[p] << "\": " << phases[p];
+    }
+    // Summed over threads, so it can exceed the forward phase with -j
+    out << ", \"lookup\": " << lookupNs / 1e6 << "},\n";
+    out << "  \"threads\": " << all.size() << ",\n";
+    out << "  \"lookups\": " << lookups << ",\n";
+    out << "  \"unreachable\": " << sum(all, &ThreadStats::unreachable) << ",\n";
+    out << "  \"no_interface\": " << sum(all, &ThreadStats::noInterface) << ",\n";
+
+    // Where the lookup tables live decides how many lookups miss the TLB
+    HugePageReport pages = hugePageReport();
+    out << "  \"pages\": {\"hugepages\": " << (pages.enabled ? "true" : "false") << ", \"base_page\": " << pages.basePage
+        << ", \"huge_page\": " << pages.hugePage << ", \"hugetlb_bytes\": " << pages.hugetlbBytes
+        << ", \"thp_advised_bytes\": " << pages.advisedBytes << ", \"anon_huge_bytes\": " << pages.anonHugeBytes
+        << ", \"shmem_huge_bytes\": " << pages.shmemHugeBytes << ", \"hugetlb_free\": " << pages.hugetlbFree
+        << ", \"transparent\": ";
+    writeString(out, pages.transparent);
+    out << "},\n";
+
+    out << "  \"latency_ns\": [";
+    bool first = true;
+    for (int b = 0; b < ThreadStats::LATENCY_BUCKETS; b++) {
+        uint64_t n = 0;
+        for (auto *t : all) {
+            n += t->latency[b].load(std::memory_order_relaxed);
+        }
+        if (n > 0) {
+            out << (first ? "" : ",") << "\n    {\"below\": " << ((uint64_t) 1 << b) << ", \"lookups\": " << n << "}";
+            first = false;
+        }
+    }
+    out << (first ? "" : "\n  ") << "],\n";
+
+    const auto &ifs = fib.interfaceTable();
+    out << "  \"interfaces\": [";
+    for (size_t i = 0; i < ifs.size(); i++) {
+        uint64_t n = 0;
+        for (auto *t : all) {
+            n += i < t->ifaceCount ? t->ifaces[i].load(std::memory_order_relaxed) : 0;
+        }
+        out << (i ? "," : "") << "\n    {\"name\": ";
+        writeString(out, ifs.name(i));
+        out << ", \"packets\": " << n << "}";
+    }
+    out << (ifs.size() ? "\n  " : "") << "],\n";
+
+    // Only routes that matched something, busiest first
+    const auto &names = fib.trackedRoutes();
+    std::vector<std::pair<uint64_t, size_t>> busy;
+    for (size_t r = 0; r < names.size(); r++) {
+        uint64_t n = 0;
+        for (auto *t : all) {
+            n += r < t->routeCapacity ? t->routes[r].load(std::memory_order_relaxed) : 0;
+        }
+        if (n > 0) {
+            busy.emplace_back(n, r);
+        }
+    }
+    std::sort(busy.begin(), busy.end(), [](const std::pair<uint64_t, size_t> &a, const std::pair<uint64_t, size_t> &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    out << "  \"untracked_routes\": " << sum(all, &ThreadStats::untracked) << ",\n";
+    out << "  \"routes\": [";
+    for (size_t i = 0; i < busy.size(); i++) {
+        const TrackedRoute &r = names[busy[i].second];
+        out << (i ? "," : "") << "\n    {\"prefix\": \"" << numToIP(r.network) << "/" << (int) r.maskLen
+            << "\", \"connected\": " << (r.connected ? "true" : "false") << ", \"packets\": " << busy[i].first << "}";
+    }
+    out << (busy.empty() ? "" : "\n  ") << "]\n}\n";
+
+    if (!out.flush()) {
+        ERROR << "Could not write statistics to " << path << "." << ENDL;
+        return false;
+    }
+    return true;
+}
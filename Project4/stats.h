@@ -0,0 +1,93 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "fib.h"
+
+// Counters of one forwarding thread. Only the owning thread writes them, so
+// an increment is a relaxed load and store rather than a locked add, and the
+// struct and each of its arrays take their own cache lines so threads never
+// write to a shared one. The stats dump may read them at any time and then
+// sees counts that are at most a moment old.
+struct alignas(64) ThreadStats {
+    // Bucket b counts lookups of less than 2^b nanoseconds
+    static constexpr int LATENCY_BUCKETS = 32;
+
+    ThreadStats(size_t routeCapacity, size_t interfaces);
+
+    // Count one forwarding decision, route is an id from Fib::trackedRoutes()
+    // or NO_ROUTE when it is not known
+    void record(const ForwardResult &r, int32_t route) {
+        if (r.status == FWD_NO_ROUTE) {
+            bump(unreachable);
+        } else if (r.status == FWD_NO_INTERFACE) {
+            bump(noInterface);
+        } else if ((size_t) r.iface < ifaceCount) {
+            bump(ifaces[r.iface]);
+        }
+        if (route != NO_ROUTE) {
+            bump((size_t) route < routeCapacity ? routes[route] : untracked);
+        }
+    }
+
+    // Count n lookups that took ns together. A batch only has one time, so
+    // each of its lookups goes in the bucket of the batch's average.
+    void recordLookups(uint64_t ns, size_t n) {
+        if (n == 0) {
+            return;
+        }
+        uint64_t each = ns / n;
+        int bucket = each == 0 ? 0 : 64 - __builtin_clzll(each);
+        bump(latency[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1], n);
+        bump(lookups, n);
+        bump(lookupNs, ns);
+    }
+
+    static void bump(std::atomic<uint64_t> &c, uint64_t n = 1) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    size_t routeCapacity;
+    size_t ifaceCount;
+    std::vector<std::atomic<uint64_t>> routes;  // by route id
+    std::vector<std::atomic<uint64_t>> ifaces;  // packets sent out each interface
+    std::atomic<uint64_t> untracked{0};         // matched routes added past routeCapacity
+    std::atomic<uint64_t> unreachable{0};
+    std::atomic<uint64_t> noInterface{0};
+    std::atomic<uint64_t> lookups{0};
+    std::atomic<uint64_t> lookupNs{0};
+    std::atomic<uint64_t> latency[LATENCY_BUCKETS] = {};
+};
+
+// Statistics of one run for --stats: per route and per interface packet
+// counts, a lookup latency histogram and how long each phase took. Nothing
+// here is touched unless --stats is given, the forwarding code only checks
+// for a null ThreadStats pointer.
+class Stats {
+public:
+    enum Phase { PARSE, LOAD, BUILD, UPDATES, FORWARD, TOTAL, PHASES };
+
+    // Counters for a new forwarding thread, sized for fib. Routes added
+    // later than 64k past the current table only show up as untracked.
+    ThreadStats *registerThread(const Fib &fib);
+
+    // Add ms to the time spent in phase p
+    void addPhase(Phase p, double ms);
+
+    // Write everything counted so far to path as JSON, naming routes and
+    // interfaces from fib
+    bool write(const std::string &path, const Fib &fib);
+
+private:
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadStats>> threads;
+    double phaseMs[PHASES] = {};
+};
+
+#endif
@@ -0,0 +1,609 @@
+/*
+    Differential test for the lookup engines. Every engine, with and without
+    route tracking, answers the same destinations on random tables, and each
+    decision is compared with the original scans, findRoute() and
+    findOutgoingInterface(). The sample1 and sample2 tables are run through
+    every engine as well and have to reproduce their expected output, and
+    once more through the librouter.h API.
+
+    Random tables are built to hit the corner cases: prefixes clustered
+    around one address so they nest and overlap, /0 and /32, routes listed
+    twice, next hops on no interface, and interfaces that share a subnet
+    like gi0 and gi1 in sample2. Destinations favour network and broadcast
+    addresses and their neighbours. One table of 40000 routes checks that
+    tracking past what dir24 can number falls back to the trie.
+
+    A divergence is shrunk to the fewest interfaces and routes that still
+    show it and printed as config files with the destination, ready for
+    ./router -c interfaces.txt -r routes.txt.
+
+    Every fifth random table then takes batches of route announcements and
+    withdrawals through Fib::addRoute() and withdrawRoute(), and after every
+    batch each engine is compared again with findRoute() on the routes as
+    they stand. A divergence there prints the table and the updates so far
+    as a file for -u.
+
+    Build and run with: make test
+    Options: lpm_test [-n <tables>] [-s <seed>] [-g <sampleDir,...>]
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "router.h"
+#include "librouter.h"
+#include "fib.h"
+#include "dir24.h"
+#include "output.h"
+#include "parse.h"
+
+static const char *ENGINES[] = {"linear", "simd", "trie", "dir24", "poptrie", "poptrie:0", "poptrie:7", "poptrie:22"};
+
+// Destinations tried on every random table
+static const size_t DESTS = 2000;
+
+static uint32_t maskOf(int maskLen) {
+    return maskLen ? ~0u << (32 - maskLen) : 0;
+}
+
+struct Case {
+    std::vector<InterfaceEntry> interfaces;
+    std::vector<RouteEntry> routes;
+};
+
+// A forwarding decision the way the original router made it: a directly
+// connected subnet first, the longest one on the first interface listing
+// it, otherwise findRoute() and the interface facing its next hop
+static ForwardResult reference(uint32_t dest, Case &c) {
+    InterfaceEntry *local = nullptr;
+    for (auto &i : c.interfaces) {
+        if (applyMask(dest, i.maskLen) == i.network && (!local || i.maskLen > local->maskLen)) {
+            local = &i;
+        }
+    }
+    if (local) {
+        return {dest, dest, (int32_t) (local - c.interfaces.data()), FWD_CONNECTED};
+    }
+    RouteEntry *r = findRoute(dest, c.routes);
+    if (!r) {
+        return {dest, 0, UNRESOLVED, FWD_NO_ROUTE};
+    }
+    InterfaceEntry *out = findOutgoingInterface(r->nextHop, c.interfaces);
+    if (!out) {
+        return {dest, r->nextHop, UNRESOLVED, FWD_NO_INTERFACE};
+    }
+    return {dest, r->nextHop, (int32_t) (out - c.interfaces.data()), FWD_GATEWAY};
+}
+
+// Only the fields the status gives a meaning to
+static bool sameDecision(const ForwardResult &a, const ForwardResult &b) {
+    if (a.status != b.status) {
+        return false;
+    }
+    switch (a.status) {
+    case FWD_GATEWAY:
+        return a.iface == b.iface && a.nextHop == b.nextHop;
+    case FWD_CONNECTED:
+        return a.iface == b.iface;
+    case FWD_NO_INTERFACE:
+        return a.nextHop == b.nextHop;
+    default:
+        return true;
+    }
+}
+
+static std::string describe(const ForwardResult &r) {
+    static const char *STATUS[] = {"gateway", "connected", "no route", "no interface"};
+    std::string s = STATUS[r.status];
+    if (r.status == FWD_GATEWAY || r.status == FWD_CONNECTED) {
+        s += " iface " + std::to_string(r.iface);
+    }
+    if (r.status == FWD_GATEWAY || r.status == FWD_NO_INTERFACE) {
+        s += " via " + numToIP(r.nextHop);
+    }
+    return s;
+}
+
+static Case randomCase(std::mt19937 &rng) {
+    Case c;
+    uint32_t base = rng();
+    auto address = [&] { return rng() % 4 ? base ^ (rng() & 0xFFFF) : (uint32_t) rng(); };
+    auto length = [&] {
+        int pick = (int) (rng() % 10);
+        return pick == 0 ? 0 : pick == 1 ? 32 : (int) (rng() % 33);
+    };
+
+    size_t interfaces = 1 + rng() % 8;
+    for (size_t i = 0; i < interfaces; i++) {
+        int len = 8 + (int) (rng() % 25);
+        uint32_t ip = address();
+        c.interfaces.push_back({"if" + std::to_string(i), ip, len, applyMask(ip, len)});
+        // A second interface on the same subnet, as gi0 and gi1
+        if (rng() % 4 == 0) {
+            c.interfaces.push_back({"dup" + std::to_string(i), ip, len, applyMask(ip, len)});
+        }
+    }
+
+    size_t routes = 1 + rng() % 200;
+    for (size_t i = 0; i < routes; i++) {
+        int len = length();
+        // Mostly a gateway on some interface subnet, sometimes off all of them
+        const InterfaceEntry &i2 = c.interfaces[rng() % c.interfaces.size()];
+        uint32_t nextHop = rng() % 5 ? i2.network | ((uint32_t) rng() & ~maskOf(i2.maskLen)) : (uint32_t) rng();
+        c.routes.push_back({applyMask(address(), len), len, nextHop});
+        if (rng() % 10 == 0) {
+            c.routes.push_back({c.routes.back().network, len, (uint32_t) rng()});
+        }
+    }
+    return c;
+}
+
+static std::vector<uint32_t> randomDests(const Case &c, std::mt19937 &rng) {
+    std::vector<uint32_t> dests;
+    dests.reserve(DESTS);
+    while (dests.size() < DESTS) {
+        uint32_t net, mask;
+        if (rng() % 2 && !c.routes.empty()) {
+            const RouteEntry &r = c.routes[rng() % c.routes.size()];
+            net = r.network;
+            mask = maskOf(r.maskLen);
+        } else {
+            const InterfaceEntry &i = c.interfaces[rng() % c.interfaces.size()];
+            net = i.network;
+            mask = maskOf(i.maskLen);
+        }
+        switch (rng() % 5) {
+        case 0: dests.push_back(net); break;
+        case 1: dests.push_back(net | ~mask); break;
+        case 2: dests.push_back(net - 1); break;
+        case 3: dests.push_back((net | ~mask) + 1); break;
+        default: dests.push_back(net | ((uint32_t) rng() & ~mask)); break;
+        }
+        if (rng() % 8 == 0) {
+            dests.back() = rng();
+        }
+    }
+    return dests;
+}
+
+// The first destination engine gets wrong in c, with its answer. Single and
+// batched lookups are both checked.
+static bool findDivergence(Case &c, const std::vector<uint32_t> &dests, const char *engine, bool tracking,
+                           uint32_t &dest, ForwardResult &got) {
+    Fib fib;
+    fib.setRouteTracking(tracking);
+    if (!fib.build(c.interfaces, c.routes, makeEngine(engine))) {
+        dest = 0;
+        got = {0, 0, UNRESOLVED, -1};
+        return true;
+    }
+    std::vector<ForwardResult> batch(dests.size());
+    for (size_t i = 0; i < dests.size(); i += LpmEngine::BATCH) {
+        fib.resolveBatch(&dests[i], &batch[i], std::min(LpmEngine::BATCH, dests.size() - i));
+    }
+    for (size_t i = 0; i < dests.size(); i++) {
+        ForwardResult want = reference(dests[i], c);
+        ForwardResult one = fib.resolve(dests[i]);
+        if (!sameDecision(one, want) || !sameDecision(batch[i], want)) {
+            dest = dests[i];
+            got = sameDecision(one, want) ? batch[i] : one;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drop routes, then interfaces, for as long as dest still goes wrong
+static void shrink(Case &c, uint32_t dest, const char *engine, bool tracking) {
+    std::vector<uint32_t> just(1, dest);
+    uint32_t d;
+    ForwardResult r;
+    for (size_t i = c.routes.size(); i-- > 0;) {
+        Case smaller = c;
+        smaller.routes.erase(smaller.routes.begin() + i);
+        if (findDivergence(smaller, just, engine, tracking, d, r)) {
+            c = smaller;
+        }
+    }
+    for (size_t i = c.interfaces.size(); i-- > 0 && c.interfaces.size() > 1;) {
+        Case smaller = c;
+        smaller.interfaces.erase(smaller.interfaces.begin() + i);
+        if (findDivergence(smaller, just, engine, tracking, d, r)) {
+            c = smaller;
+        }
+    }
+}
+
+static void printReproducer(Case &c, uint32_t dest, const char *engine, bool tracking) {
+    uint32_t d;
+    ForwardResult got;
+    std::vector<uint32_t> just(1, dest);
+    findDivergence(c, just, engine, tracking, d, got);
+    printf("  --lpm=%s%s disagrees on %s\n", engine, tracking ? " with route tracking (--stats)" : "", numToIP(dest).c_str());
+    if (got.status < 0) {
+        printf("  the engine could not be built\n");
+    } else {
+        printf("  expected %s, got %s\n", describe(reference(dest, c)).c_str(), describe(got).c_str());
+    }
+    printf("  interfaces.txt:\n");
+    for (auto &i : c.interfaces) {
+        printf("    %s %s/%d\n", i.name.c_str(), numToIP(i.ip).c_str(), i.maskLen);
+    }
+    printf("  routes.txt:\n");
+    for (auto &r : c.routes) {
+        printf("    %s/%d %s\n", numToIP(r.network).c_str(), r.maskLen, numToIP(r.nextHop).c_str());
+    }
+}
+
+// The part of a sample's output.txt under "Expected:", or all of it when
+// there is no such header
+static std::string expectedOutput(const std::string &dir) {
+    std::ifstream expectedFile(dir + "/output.txt");
+    std::string expected, line;
+    while (std::getline(expectedFile, line)) {
+        if (line == "Expected:") {
+            continue;
+        }
+        if (line.empty()) {
+            if (!expected.empty()) {
+                break;
+            }
+            continue;
+        }
+        expected += line + "\n";
+    }
+    return expected;
+}
+
+static std::vector<uint32_t> sampleDests(const std::string &dir) {
+    std::ifstream in(dir + "/input.txt");
+    std::vector<uint32_t> dests;
+    std::string line;
+    while (std::getline(in, line)) {
+        const char *p = line.data(), *end = p + line.size();
+        uint32_t dest;
+        if (p != end && !isComment(p, end) && readDestination(p, end, end, dest)) {
+            dests.push_back(dest);
+        }
+    }
+    return dests;
+}
+
+// Run a sample directory through an engine and compare with its expected output
+static bool checkSample(const std::string &dir, const char *engine, bool tracking) {
+    std::string expected = expectedOutput(dir);
+    if (expected.empty()) {
+        printf("FAIL %s: no expected output in %s/output.txt\n", dir.c_str(), dir.c_str());
+        return false;
+    }
+
+    Fib fib;
+    fib.setRouteTracking(tracking);
+    std::vector<InterfaceEntry> interfaces;
+    std::vector<RouteEntry> routes;
+    if (!parseInterfaces(dir + "/interfaces.txt", interfaces) || !parseRoutes(dir + "/routes.txt", routes) ||
+        !fib.build(std::move(interfaces), routes, makeEngine(engine))) {
+        printf("FAIL %s --lpm=%s: could not build\n", dir.c_str(), engine);
+        return false;
+    }
+    std::vector<uint32_t> dests = sampleDests(dir);
+    OutputWriter out(OutputWriter::MEMORY_ONLY);
+    processBatch(dests.data(), dests.size(), fib, out);
+    std::string actual(out.data(), out.size());
+    if (actual != expected) {
+        printf("FAIL %s --lpm=%s%s: output differs from %s/output.txt\n", dir.c_str(), engine,
+               tracking ? " with route tracking" : "", dir.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The same through the library API, which also has to report a missing file
+// rather than exit
+static bool checkLibrary(const std::string &dir) {
+    Router router;
+    if (router.load(dir + "/missing.txt", dir + "/routes.txt") || router.lastError().empty()) {
+        printf("FAIL %s: librouter loaded a missing interface file\n", dir.c_str());
+        return false;
+    }
+    if (!router.load(dir + "/interfaces.txt", dir + "/routes.txt")) {
+        printf("FAIL %s: librouter could not load: %s\n", dir.c_str(), router.lastError().c_str());
+        return false;
+    }
+    std::vector<uint32_t> dests = sampleDests(dir);
+    std::vector<ForwardResult> results(dests.size());
+    router.lookupBatch(dests.data(), results.data(), dests.size());
+    std::string actual;
+    for (size_t i = 0; i < dests.size(); i++) {
+        ForwardResult one = router.lookup(dests[i]);
+        if (memcmp(&one, &results[i], sizeof(one)) != 0) {
+            printf("FAIL %s: librouter lookup and lookupBatch disagree on %s\n", dir.c_str(), numToIP(dests[i]).c_str());
+            return false;
+        }
+        actual += router.format(results[i]) + "\n";
+    }
+    if (actual != expectedOutput(dir)) {
+        printf("FAIL %s: librouter output differs from %s/output.txt\n", dir.c_str(), dir.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Routes in the large table, more than dir24 can number with tracking
+static const size_t LARGE_ROUTES = 40000;
+
+// Every engine on a table too large for dir24 to number its prefixes, with
+// and without tracking. dir24 with tracking has to end up on the trie, both
+// when built that large and when updates grow it past the limit.
+static size_t checkLargeTable(unsigned seed) {
+    std::mt19937 rng(seed);
+    Case c;
+    c.interfaces.push_back({"if0", 0x0A000001, 8, 0x0A000000});
+    c.interfaces.push_back({"if1", 0xC0A80001, 16, 0xC0A80000});
+    // Each prefix once, so adding it later means the same as listing it
+    std::set<std::pair<uint32_t, int>> seen;
+    while (c.routes.size() < LARGE_ROUTES) {
+        int len = 8 + (int) (rng() % 25);
+        uint32_t network = applyMask(rng(), len);
+        uint32_t nextHop = rng() % 2 ? 0x0A000000 | (rng() % 64) : 0xC0A80000 | (rng() % 64);
+        if (seen.insert({network, len}).second) {
+            c.routes.push_back({network, len, nextHop});
+        }
+    }
+    std::vector<uint32_t> dests = randomDests(c, rng);
+    std::vector<ForwardResult> want(dests.size());
+    for (size_t i = 0; i < dests.size(); i++) {
+        want[i] = reference(dests[i], c);
+    }
+
+    auto agrees = [&](const Fib &fib, const char *engine, bool tracking, const char *how) {
+        for (size_t i = 0; i < dests.size(); i++) {
+            ForwardResult got = fib.resolve(dests[i]);
+            if (!sameDecision(got, want[i])) {
+                printf("FAIL large table of seed %u --lpm=%s%s %s: expected %s for %s, got %s\n", seed, engine,
+                       tracking ? " with route tracking" : "", how, describe(want[i]).c_str(), numToIP(dests[i]).c_str(),
+                       describe(got).c_str());
+                return false;
+            }
+        }
+        return true;
+    };
+
+    size_t failures = 0;
+    for (const char *engine : ENGINES) {
+        for (bool tracking : {false, true}) {
+            Fib fib;
+            fib.setRouteTracking(tracking);
+            if (!fib.build(c.interfaces, c.routes, makeEngine(engine))) {
+                printf("FAIL large table of seed %u --lpm=%s%s: could not build\n", seed, engine, tracking ? " with route tracking" : "");
+                failures++;
+                continue;
+            }
+            failures += !agrees(fib, engine, tracking, "built");
+        }
+    }
+
+    // Grow a dir24 table with tracking past its limit one route at a time
+    Fib fib;
+    fib.setRouteTracking(true);
+    size_t start = (size_t) Dir24Table::MAX_HOPS - 100;
+    std::vector<RouteEntry> first(c.routes.begin(), c.routes.begin() + start);
+    if (!fib.build(c.interfaces, first, makeEngine("dir24"))) {
+        printf("FAIL large table of seed %u --lpm=dir24 with route tracking: could not build\n", seed);
+        return failures + 1;
+    }
+    for (size_t i = start; i < c.routes.size(); i++) {
+        fib.addRoute(c.routes[i].network, c.routes[i].maskLen, c.routes[i].nextHop);
+    }
+    failures += !agrees(fib, "dir24", true, "after updates");
+    if (std::string(fib.lpm().name()) != "trie") {
+        printf("FAIL large table of seed %u: dir24 kept %zu tracked routes\n", seed, fib.prefixTable().size());
+        failures++;
+    }
+    return failures;
+}
+
+// Batches of random route changes applied to every UPDATE_EVERY-th table,
+// and changes per batch. Short prefixes make dir24 updates slow.
+static const size_t UPDATE_EVERY = 5;
+static const size_t UPDATE_BATCHES = 5;
+static const size_t UPDATES_PER_BATCH = 20;
+
+struct RouteChange {
+    bool withdraw;
+    RouteEntry route;
+};
+
+// What c becomes after a change: an announced prefix replaces every earlier
+// listing of it, a withdrawn one is gone
+static void applyChange(Case &c, const RouteChange &u) {
+    auto &routes = c.routes;
+    routes.erase(std::remove_if(routes.begin(), routes.end(), [&](const RouteEntry &r) {
+        return r.network == u.route.network && r.maskLen == u.route.maskLen;
+    }), routes.end());
+    if (!u.withdraw) {
+        routes.push_back(u.route);
+    }
+}
+
+// Mostly announcements near the prefixes already there, some withdrawals of
+// routes in the table and some of prefixes that are not
+static RouteChange randomChange(const Case &c, std::mt19937 &rng) {
+    const InterfaceEntry &i = c.interfaces[rng() % c.interfaces.size()];
+    uint32_t nextHop = rng() % 5 ? i.network | ((uint32_t) rng() & ~maskOf(i.maskLen)) : (uint32_t) rng();
+    if (!c.routes.empty() && rng() % 3 == 0) {
+        const RouteEntry &r = c.routes[rng() % c.routes.size()];
+        return {true, {r.network, r.maskLen, 0}};
+    }
+    // Short prefixes are rare, each one rewrites much of a dir24 table
+    int pick = (int) (rng() % 20);
+    int len = pick == 0 ? 0 : pick < 3 ? 32 : 8 + (int) (rng() % 25);
+    uint32_t near = c.routes.empty() ? i.network : c.routes[rng() % c.routes.size()].network;
+    uint32_t network = applyMask(rng() % 4 ? near ^ (rng() & 0xFFFF) : (uint32_t) rng(), len);
+    return {rng() % 8 == 0, {network, len, nextHop}};
+}
+
+static void printUpdates(const Case &start, const std::vector<RouteChange> &changes) {
+    printf("  interfaces.txt:\n");
+    for (auto &i : start.interfaces) {
+        printf("    %s %s/%d\n", i.name.c_str(), numToIP(i.ip).c_str(), i.maskLen);
+    }
+    printf("  routes.txt:\n");
+    for (auto &r : start.routes) {
+        printf("    %s/%d %s\n", numToIP(r.network).c_str(), r.maskLen, numToIP(r.nextHop).c_str());
+    }
+    printf("  updates for -u:\n");
+    for (auto &u : changes) {
+        if (u.withdraw) {
+            printf("    -%s/%d\n", numToIP(u.route.network).c_str(), u.route.maskLen);
+        } else {
+            printf("    +%s/%d %s\n", numToIP(u.route.network).c_str(), u.route.maskLen, numToIP(u.route.nextHop).c_str());
+        }
+    }
+}
+
+// Every engine, with and without tracking, takes the same random changes
+// through addRoute() and withdrawRoute(), and after each batch has to agree
+// with findRoute() on the routes as they are then
+static size_t checkUpdates(const Case &start, const std::vector<uint32_t> &dests, std::mt19937 &rng, size_t table, unsigned seed) {
+    struct Subject {
+        const char *engine;
+        bool tracking;
+        std::unique_ptr<Fib> fib;
+        bool failed;
+    };
+    std::vector<Subject> subjects;
+    for (const char *engine : ENGINES) {
+        // Every poptrie change is a rebuild, which with a 22 bit direct table
+        // means 16 MB each time, so that one only takes the first table's
+        if (table > 0 && strcmp(engine, "poptrie:22") == 0) {
+            continue;
+        }
+        for (bool tracking : {false, true}) {
+            std::unique_ptr<Fib> fib(new Fib());
+            fib->setRouteTracking(tracking);
+            // A table that does not build is already reported by findDivergence()
+            if (fib->build(start.interfaces, start.routes, makeEngine(engine))) {
+                subjects.push_back({engine, tracking, std::move(fib), false});
+            }
+        }
+    }
+
+    Case now = start;
+    std::vector<RouteChange> changes;
+    std::vector<ForwardResult> want(dests.size()), batch(dests.size());
+    size_t failures = 0;
+    for (size_t b = 0; b < UPDATE_BATCHES; b++) {
+        for (size_t n = 0; n < UPDATES_PER_BATCH; n++) {
+            RouteChange u = randomChange(now, rng);
+            changes.push_back(u);
+            applyChange(now, u);
+            for (auto &s : subjects) {
+                if (u.withdraw) {
+                    s.fib->withdrawRoute(u.route.network, u.route.maskLen);
+                } else {
+                    s.fib->addRoute(u.route.network, u.route.maskLen, u.route.nextHop);
+                }
+            }
+        }
+        for (size_t i = 0; i < dests.size(); i++) {
+            want[i] = reference(dests[i], now);
+        }
+
+        for (auto &s : subjects) {
+            if (s.failed) {
+                continue;
+            }
+            for (size_t i = 0; i < dests.size(); i += LpmEngine::BATCH) {
+                s.fib->resolveBatch(&dests[i], &batch[i], std::min(LpmEngine::BATCH, dests.size() - i));
+            }
+            for (size_t i = 0; i < dests.size(); i++) {
+                ForwardResult one = s.fib->resolve(dests[i]);
+                if (!sameDecision(one, want[i]) || !sameDecision(batch[i], want[i])) {
+                    ForwardResult got = sameDecision(one, want[i]) ? batch[i] : one;
+                    printf("FAIL table %zu of seed %u after %zu updates:\n", table, seed, changes.size());
+                    printf("  --lpm=%s%s disagrees on %s\n", s.engine, s.tracking ? " with route tracking (--stats)" : "",
+                           numToIP(dests[i]).c_str());
+                    printf("  expected %s, got %s\n", describe(want[i]).c_str(), describe(got).c_str());
+                    printUpdates(start, changes);
+                    s.failed = true;
+                    failures++;
+                    break;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    size_t tables = 100;
+    unsigned seed = 1;
+    std::vector<std::string> samples = {"sample1/sample1", "sample2/sample2", "sample3/sample3"};
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i], arg = argv[i + 1];
+        if (flag == "-n") {
+            tables = std::stoul(arg);
+        } else if (flag == "-s") {
+            seed = (unsigned) std::stoul(arg);
+        } else if (flag == "-g") {
+            samples.clear();
+            for (size_t pos = 0; pos < arg.size();) {
+                size_t comma = arg.find(',', pos);
+                samples.push_back(arg.substr(pos, comma - pos));
+                pos = comma == std::string::npos ? arg.size() : comma + 1;
+            }
+        } else {
+            printf("Usage: lpm_test [-n <tables>] [-s <seed>] [-g <sampleDir,...>]\n");
+            return 1;
+        }
+    }
+
+    // Failures are reported here, not by the router's own messages
+    LOG_LEVEL = 1;
+    size_t failures = 0;
+
+    for (const std::string &dir : samples) {
+        for (const char *engine : ENGINES) {
+            for (bool tracking : {false, true}) {
+                failures += !checkSample(dir, engine, tracking);
+            }
+        }
+        failures += !checkLibrary(dir);
+    }
+
+    std::mt19937 rng(seed);
+    for (size_t t = 0; t < tables; t++) {
+        Case c = randomCase(rng);
+        std::vector<uint32_t> dests = randomDests(c, rng);
+        for (const char *engine : ENGINES) {
+            for (bool tracking : {false, true}) {
+                uint32_t dest;
+                ForwardResult got;
+                if (findDivergence(c, dests, engine, tracking, dest, got)) {
+                    printf("FAIL table %zu of seed %u:\n", t, seed);
+                    Case small = c;
+                    shrink(small, dest, engine, tracking);
+                    printReproducer(small, dest, engine, tracking);
+                    failures++;
+                }
+            }
+        }
+        if (t % UPDATE_EVERY == 0) {
+            failures += checkUpdates(c, dests, rng, t, seed);
+        }
+    }
+    failures += checkLargeTable(seed);
+
+    printf("%zu engines, %zu samples, %zu random tables and one of %zu routes of seed %u: %s\n",
+           sizeof(ENGINES) / sizeof(ENGINES[0]), samples.size(), tables, LARGE_ROUTES, seed, failures ? (std::to_string(failures) + " failures").c_str() : "all agree");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,331 @@
+#include <atomic>
+#include <thread>
+#include "trie.h"
+
+// Returns bit number pos (0 is the most significant) of an address
+static inline int bitAt(uint32_t ip, int pos) {
+    return (ip >> (31 - pos)) & 1;
+}
+
+// Number of leading bits two addresses have in common
+static inline int commonBits(uint32_t a, uint32_t b) {
+    uint32_t diff = a ^ b;
+    return diff == 0 ? 32 : __builtin_clz(diff);
+}
+
+// Below this many prefixes threads cost more than they save
+static const size_t PARALLEL_MIN_PREFIXES = 1 << 16;
+
+static bool fitsHops(const PrefixTable &prefixes, int maxAllowed) {
+    int maxHop = prefixes.size() ? *std::max_element(prefixes.hop.begin(), prefixes.hop.end()) : 0;
+    if (maxHop > maxAllowed) {
+        ERROR << "Too many next hops for the trie (" << maxHop + 1 << ")." << ENDL;
+        return false;
+    }
+    return true;
+}
+
+RouteTrie::RouteTrie() : pool(1, Node{0, NO_ROUTE, 0, {0, 0}}) {}
+
+void RouteTrie::reset(size_t size, uint32_t prefix, int maskLen) {
+    // A path-compressed trie has fewer than two nodes per prefix
+    pool.assign(1, Node{prefix, NO_ROUTE, (uint32_t) maskLen, {0, 0}});
+    pool.reserve(2 * size + 1);
+    freeList = 0;
+    freeCount = 0;
+}
+
+bool RouteTrie::build(const PrefixTable &prefixes) {
+    if (!fitsHops(prefixes, MAX_HOPS)) {
+        return false;
+    }
+    reset(prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        insert(prefixes.network[i], prefixes.maskLen[i], prefixes.hop[i]);
+    }
+    relayout();
+    return true;
+}
+
+bool RouteTrie::buildParallel(const PrefixTable &prefixes, int threads) {
+    if (threads <= 1 || prefixes.size() < PARALLEL_MIN_PREFIXES) {
+        return build(prefixes);
+    }
+    if (!fitsHops(prefixes, MAX_HOPS)) {
+        return false;
+    }
+
+    // Group the prefixes of /8 and longer by first octet, keeping file order
+    // within a group so the first of two equal prefixes still wins
+    const int GROUPS = 256;
+    std::vector<uint32_t> start(GROUPS + 1, 0);
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        if (prefixes.maskLen[i] >= 8) {
+            start[(prefixes.network[i] >> 24) + 1]++;
+        }
+    }
+    for (int g = 0; g < GROUPS; g++) {
+        start[g + 1] += start[g];
+    }
+    std::vector<uint32_t> order(start[GROUPS]);
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        if (prefixes.maskLen[i] >= 8) {
+            order[fill[prefixes.network[i] >> 24]++] = (uint32_t) i;
+        }
+    }
+
+    // Each group becomes a trie of its own whose root is the /8
+    std::vector<RouteTrie> subtrees(GROUPS);
+    std::atomic<int> nextGroup{0};
+    auto work = [&] {
+        for (int g; (g = nextGroup.fetch_add(1)) < GROUPS;) {
+            RouteTrie &t = subtrees[g];
+            t.reset(start[g + 1] - start[g], (uint32_t) g << 24, 8);
+            for (uint32_t k = start[g]; k < start[g + 1]; k++) {
+                uint32_t i = order[k];
+                t.insert(prefixes.network[i], prefixes.maskLen[i], prefixes.hop[i]);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < std::min(threads, GROUPS); t++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    // The short prefixes and one node per /8 make up the top of the trie
+    reset(prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        if (prefixes.maskLen[i] < 8) {
+            insert(prefixes.network[i], prefixes.maskLen[i], prefixes.hop[i]);
+        }
+    }
+    for (int g = 0; g < GROUPS; g++) {
+        if (start[g + 1] == start[g]) {
+            continue;
+        }
+        uint32_t top = findOrCreate((uint32_t) g << 24, 8);
+        HugeVector<Node> &nodes = subtrees[g].pool;
+
+        // The subtree's nodes follow on from here, its root merges into top
+        uint32_t base = (uint32_t) pool.size() - 1;
+        auto moved = [base](uint32_t c) { return c ? c + base : 0; };
+        pool[top].hop = nodes[0].hop;
+        pool[top].child[0] = moved(nodes[0].child[0]);
+        pool[top].child[1] = moved(nodes[0].child[1]);
+        for (size_t k = 1; k < nodes.size(); k++) {
+            Node n = nodes[k];
+            n.child[0] = moved(n.child[0]);
+            n.child[1] = moved(n.child[1]);
+            pool.push_back(n);
+        }
+        HugeVector<Node>().swap(nodes);
+    }
+
+    // The /8 nodes on their own may neither hold a route nor branch,
+    // relayout() leaves those out
+    relayout();
+    return true;
+}
+
+uint32_t RouteTrie::allocate(uint32_t prefix, int maskLen) {
+    Node fresh{applyMask(prefix, maskLen), NO_ROUTE, (uint32_t) maskLen, {0, 0}};
+    if (freeList) {
+        uint32_t node = freeList;
+        freeList = pool[node].child[0];
+        freeCount--;
+        pool[node] = fresh;
+        return node;
+    }
+    pool.push_back(fresh);
+    return (uint32_t) pool.size() - 1;
+}
+
+void RouteTrie::release(uint32_t node) {
+    pool[node] = Node{0, NO_ROUTE, 0, {freeList, 0}};
+    freeList = node;
+    freeCount++;
+}
+
+void RouteTrie::relayout() {
+    HugeVector<Node> ordered;
+    ordered.reserve(nodeCount());
+    ordered.push_back(pool[0]);
+
+    // Children are appended as their parent is visited, so the queue is
+    // the new array itself and its links are rewritten as it is walked
+    for (size_t i = 0; i < ordered.size(); i++) {
+        for (uint32_t &c : ordered[i].child) {
+            while (c && pool[c].hop == NO_ROUTE && !(pool[c].child[0] && pool[c].child[1])) {
+                c = pool[c].child[0] ? pool[c].child[0] : pool[c].child[1];
+            }
+            if (c) {
+                Node child = pool[c];
+                c = (uint32_t) ordered.size();
+                ordered.push_back(child);
+            }
+        }
+    }
+    pool.swap(ordered);
+    freeList = 0;
+    freeCount = 0;
+}
+
+void RouteTrie::insert(uint32_t prefix, int maskLen, int hop) {
+    // The first matching route wins on duplicates, same as findRoute()
+    uint32_t node = findOrCreate(prefix, maskLen);
+    if (pool[node].hop == NO_ROUTE) {
+        pool[node].hop = hop;
+    }
+}
+
+bool RouteTrie::update(uint32_t prefix, int maskLen, int hop) {
+    if (hop > MAX_HOPS) {
+        return false;
+    }
+    if (hop == NO_ROUTE) {
+        remove(prefix, maskLen);
+    } else {
+        pool[findOrCreate(prefix, maskLen)].hop = hop;
+    }
+    return true;
+}
+
+uint32_t RouteTrie::findOrCreate(uint32_t prefix, int maskLen) {
+    // Indices rather than references, allocate() may move the array
+    prefix = applyMask(prefix, maskLen);
+    uint32_t node = 0;
+
+    while (true) {
+        if ((int) pool[node].maskLen == maskLen) {
+            return node;
+        }
+
+        int bit = bitAt(prefix, pool[node].maskLen);
+        uint32_t next = pool[node].child[bit];
+        if (!next) {
+            uint32_t leaf = allocate(prefix, maskLen);
+            pool[node].child[bit] = leaf;
+            return leaf;
+        }
+
+        int nextLen = pool[next].maskLen;
+        int common = std::min(commonBits(pool[next].prefix, prefix), std::min(nextLen, maskLen));
+        if (common == nextLen) {
+            node = next;
+            continue;
+        }
+
+        // Split the compressed edge at the first differing bit
+        uint32_t mid = allocate(prefix, common);
+        int oldBit = bitAt(pool[next].prefix, common);
+        pool[mid].child[oldBit] = next;
+        pool[node].child[bit] = mid;
+        if (common == maskLen) {
+            return mid;
+        }
+        uint32_t leaf = allocate(prefix, maskLen);
+        pool[mid].child[oldBit ^ 1] = leaf;
+        return leaf;
+    }
+}
+
+void RouteTrie::remove(uint32_t prefix, int maskLen) {
+    prefix = applyMask(prefix, maskLen);
+    uint32_t *parentSlot = nullptr;  // links to the node's parent and to the node, none for the root
+    uint32_t *slot = nullptr;
+    uint32_t node = 0;
+
+    while ((int) pool[node].maskLen != maskLen) {
+        uint32_t &next = pool[node].child[bitAt(prefix, pool[node].maskLen)];
+        if (!next || (int) pool[next].maskLen > maskLen || applyMask(prefix, pool[next].maskLen) != pool[next].prefix) {
+            return;
+        }
+        parentSlot = slot;
+        slot = &next;
+        node = next;
+    }
+    pool[node].hop = NO_ROUTE;
+
+    // Without a route a node is only worth keeping as a branch point, so
+    // collapse it and then possibly its parent, which may have lost a branch
+    for (int pass = 0; pass < 2 && slot; pass++) {
+        uint32_t gone = *slot;
+        const Node &n = pool[gone];
+        if (n.hop != NO_ROUTE || (n.child[0] && n.child[1])) {
+            return;
+        }
+        *slot = n.child[0] ? n.child[0] : n.child[1];
+        release(gone);
+        slot = parentSlot;
+    }
+}
+
+int RouteTrie::lookup(uint32_t dest) const {
+    int best = NO_ROUTE;
+    uint32_t node = 0;
+
+    while (true) {
+        // A compressed edge may skip bits, so confirm the whole prefix matches
+        const Node &n = pool[node];
+        if (applyMask(dest, n.maskLen) != n.prefix) {
+            break;
+        }
+        if (n.hop != NO_ROUTE) {
+            best = n.hop;
+        }
+        if (n.maskLen == 32) {
+            break;
+        }
+        node = n.child[bitAt(dest, n.maskLen)];
+        if (!node) {
+            break;
+        }
+    }
+    return best;
+}
+
+void RouteTrie::lookupBatch(const uint32_t *dests, int *hops, size_t n) const {
+    const Node *nodes = pool.data();
+    for (size_t base = 0; base < n; base += LANES) {
+        size_t lanes = std::min(LANES, n - base);
+        const Node *node[LANES];
+        for (size_t i = 0; i < lanes; i++) {
+            node[i] = nodes;
+            hops[base + i] = NO_ROUTE;
+        }
+
+        // One step per active lane per round, so while one lane waits on a
+        // cache miss the others have their next node already on the way
+        size_t active = lanes;
+        while (active > 0) {
+            active = 0;
+            for (size_t i = 0; i < lanes; i++) {
+                const Node *cur = node[i];
+                if (!cur) {
+                    continue;
+                }
+                uint32_t dest = dests[base + i];
+                if (applyMask(dest, cur->maskLen) != cur->prefix) {
+                    node[i] = nullptr;
+                    continue;
+                }
+                if (cur->hop != NO_ROUTE) {
+                    hops[base + i] = cur->hop;
+                }
+                uint32_t next = cur->maskLen == 32 ? 0 : cur->child[bitAt(dest, cur->maskLen)];
+                if (next) {
+                    __builtin_prefetch(&nodes[next]);
+                    active++;
+                    node[i] = &nodes[next];
+                } else {
+                    node[i] = nullptr;
+                }
+            }
+        }
+    }
+}
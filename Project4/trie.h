@@ -0,0 +1,83 @@
+#ifndef TRIE_H
+#define TRIE_H
+
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include "hugepages.h"
+#include "lpm.h"
+
+// Path-compressed binary (Patricia) trie used for longest prefix matching.
+// Every node stores the full prefix it represents, so chains of single-child
+// nodes are collapsed and a lookup touches at most one node per branch point.
+//
+// Nodes are 16 bytes and live in one array, linked by index. A build lays
+// them out breadth first, so the top levels every lookup walks share a few
+// cache lines. Withdrawn nodes go on a free list for the next insert, and
+// the whole array is released at once.
+class RouteTrie : public LpmEngine {
+public:
+    RouteTrie();
+
+    const char *name() const override { return "trie"; }
+
+    // Rebuild the trie from a parsed routing table
+    bool build(const PrefixTable &prefixes) override;
+
+    // Builds the subtree below every /8 on its own thread and links them in
+    bool buildParallel(const PrefixTable &prefixes, int threads) override;
+
+    // Add a prefix that resolves to next hop index hop; an existing equal prefix is kept
+    void insert(uint32_t prefix, int maskLen, int hop);
+
+    // Replace or withdraw (hop NO_ROUTE) one prefix, touching only its path
+    bool update(uint32_t prefix, int maskLen, int hop) override;
+
+    // Next hop index of the longest matching prefix for dest, or NO_ROUTE
+    int lookup(uint32_t dest) const override;
+
+    // Walks LANES lookups down the trie in lock step, prefetching each next node
+    void lookupBatch(const uint32_t *dests, int *hops, size_t n) const override;
+    static constexpr size_t LANES = 8;
+
+    size_t memoryUsage() const override { return pool.size() * sizeof(Node); }
+    size_t valueLimit() const override { return (size_t) MAX_HOPS + 1; }
+
+    size_t nodeCount() const { return pool.size() - freeCount; }
+
+    // Largest next hop index a node can hold
+    static constexpr int MAX_HOPS = (1 << 23) - 1;
+
+private:
+    struct Node {
+        uint32_t prefix;
+        int32_t hop : 24;
+        uint32_t maskLen : 8;
+        uint32_t child[2];  // node indices, 0 (the root) for none
+    };
+    static_assert(sizeof(Node) == 16, "trie node layout");
+
+    // Index of a fresh node, reusing a withdrawn one when there is one
+    uint32_t allocate(uint32_t prefix, int maskLen);
+    void release(uint32_t node);
+
+    // Node for exactly prefix/maskLen, created (without a route) if missing
+    uint32_t findOrCreate(uint32_t prefix, int maskLen);
+
+    // Drop prefix/maskLen and the nodes that only existed to hold it
+    void remove(uint32_t prefix, int maskLen);
+
+    // Start over with just the root, or nothing but prefix/maskLen as the
+    // root of a subtree, with room for size prefixes
+    void reset(size_t size, uint32_t prefix = 0, int maskLen = 0);
+
+    // Renumber the nodes in breadth first order, dropping free ones and
+    // nodes that neither hold a route nor branch
+    void relayout();
+
+    HugeVector<Node> pool;
+    uint32_t freeList = 0;  // chained through child[0]
+    size_t freeCount = 0;
+};
+
+#endif